@@ -0,0 +1,132 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./arena.h"
+
+node_db::Arena::Arena(size_t chunkSize)
+    :head(NULL),
+    chunkSize(chunkSize) {
+}
+
+node_db::Arena::~Arena() {
+    while (this->head != NULL) {
+        chunk_t* next = this->head->next;
+        Arena::release(this->head);
+        this->head = next;
+    }
+}
+
+void* node_db::Arena::allocate(size_t size) throw(node_db::Exception&) {
+    size = (size + 7) & ~static_cast<size_t>(7);
+
+    if (this->head == NULL || this->head->size - this->head->used < size) {
+        // Chunks get bigger as the arena grows, so large results end up in
+        // a handful of allocations
+        if (this->head != NULL && this->chunkSize < 4 * 1024 * 1024) {
+            this->chunkSize *= 2;
+        }
+
+        size_t chunkSize = (size > this->chunkSize ? size : this->chunkSize);
+        chunk_t* chunk = static_cast<chunk_t*>(malloc(((sizeof(chunk_t) + 7) & ~static_cast<size_t>(7)) + chunkSize));
+        if (chunk == NULL) {
+            throw node_db::Exception("Could not allocate memory for rows");
+        }
+
+        chunk->next = this->head;
+        chunk->size = chunkSize;
+        chunk->used = 0;
+        chunk->refs = 1;
+        chunk->holders = 0;
+        this->head = chunk;
+    }
+
+    void* pointer = Arena::data(this->head) + this->head->used;
+    this->head->used += size;
+    return pointer;
+}
+
+void node_db::Arena::clear() {
+    chunk_t* chunk = this->head;
+    chunk_t* reusable = NULL;
+
+    // Keep the newest (biggest) chunk nobody else references for the next
+    // batch, and hand the rest over to whoever still holds them
+    while (chunk != NULL) {
+        chunk_t* next = chunk->next;
+        if (reusable == NULL && chunk->refs == 1) {
+            reusable = chunk;
+        } else {
+            Arena::release(chunk);
+        }
+        chunk = next;
+    }
+
+    if (reusable != NULL) {
+        reusable->next = NULL;
+        reusable->used = 0;
+    }
+    this->head = reusable;
+}
+
+size_t node_db::Arena::size() const {
+    size_t size = 0;
+    for (chunk_t* chunk = this->head; chunk != NULL; chunk = chunk->next) {
+        size += chunk->used;
+    }
+    return size;
+}
+
+void* node_db::Arena::retain(const void* pointer) {
+    const char* address = static_cast<const char*>(pointer);
+
+    for (chunk_t* chunk = this->head; chunk != NULL; chunk = chunk->next) {
+        const char* data = Arena::data(chunk);
+        if (address >= data && address < data + chunk->size) {
+            __sync_add_and_fetch(&(chunk->refs), 1);
+            return chunk;
+        }
+    }
+
+    return NULL;
+}
+
+// Cells handed to JS in place (Buffers, external strings) pin their chunk.
+// A cell that fills less than an eighth of its chunk isn't worth keeping the
+// whole chunk around for, so it gets no pin and is copied instead. pinned is
+// set to the chunk size when this is the first cell pinning it, so callers
+// can tell V8 about memory it keeps alive, and unpin() returns the size
+// again once the last one is gone. Both run on the main thread only.
+void* node_db::Arena::pin(const void* pointer, size_t length, size_t* pinned) {
+    *pinned = 0;
+
+    chunk_t* chunk = static_cast<chunk_t*>(this->retain(pointer));
+    if (chunk == NULL) {
+        return NULL;
+    }
+
+    if (length < chunk->size / 8) {
+        Arena::release(chunk);
+        return NULL;
+    }
+
+    if (chunk->holders++ == 0) {
+        *pinned = chunk->size;
+    }
+    return chunk;
+}
+
+size_t node_db::Arena::unpin(void* pointer) {
+    chunk_t* chunk = static_cast<chunk_t*>(pointer);
+    size_t unpinned = (--chunk->holders == 0 ? chunk->size : 0);
+    Arena::release(chunk);
+    return unpinned;
+}
+
+void node_db::Arena::release(void* pointer) {
+    chunk_t* chunk = static_cast<chunk_t*>(pointer);
+    if (__sync_sub_and_fetch(&(chunk->refs), 1) == 0) {
+        free(chunk);
+    }
+}
+
+char* node_db::Arena::data(chunk_t* chunk) {
+    return reinterpret_cast<char*>(chunk) + ((sizeof(chunk_t) + 7) & ~static_cast<size_t>(7));
+}
@@ -0,0 +1,46 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./exception.h"
+
+namespace node_db {
+// Bump allocator for the rows of a request. Row headers, length tables and
+// cell bytes are packed into large chunks that are all given back at once,
+// instead of one heap allocation per row and per cell. Chunks are reference
+// counted so memory handed out to JS (e.g. as an external Buffer) outlives
+// the arena until the last user releases it.
+class Arena {
+    public:
+        explicit Arena(size_t chunkSize = 64 * 1024);
+        ~Arena();
+        void* allocate(size_t size) throw(Exception&);
+        template <class T> T* allocate(size_t count) throw(Exception&) {
+            return static_cast<T*>(this->allocate(count * sizeof(T)));
+        }
+        void clear();
+        size_t size() const;
+        void* retain(const void* pointer);
+        void* pin(const void* pointer, size_t length, size_t* pinned);
+        static void release(void* chunk);
+        static size_t unpin(void* chunk);
+
+    protected:
+        struct chunk_t {
+            chunk_t* next;
+            size_t size;
+            size_t used;
+            volatile int refs;
+            int holders;
+        };
+        chunk_t* head;
+        size_t chunkSize;
+
+        static char* data(chunk_t* chunk);
+};
+}
+
+#endif  // ARENA_H_
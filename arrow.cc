@@ -0,0 +1,511 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./arrow.h"
+
+// Values from the Arrow format definitions (Schema.fbs and Message.fbs)
+#define ARROW_METADATA_V5 4
+#define ARROW_HEADER_SCHEMA 1
+#define ARROW_HEADER_RECORD_BATCH 3
+#define ARROW_TYPE_INT 2
+#define ARROW_TYPE_FLOATING_POINT 3
+#define ARROW_TYPE_BINARY 4
+#define ARROW_TYPE_UTF8 5
+#define ARROW_TYPE_BOOL 6
+#define ARROW_TYPE_TIMESTAMP 10
+#define ARROW_PRECISION_DOUBLE 2
+#define ARROW_TIME_UNIT_MILLISECOND 1
+
+static const char arrowMagic[8] = { 'A', 'R', 'R', 'O', 'W', '1', 0, 0 };
+
+node_db::ArrowWriter::ArrowWriter(node_db::Result* result, const std::vector<node_db::ConversionPlan::converter_t>& converters, bool file)
+    :file(file),
+    started(false),
+    rows(0),
+    position(0),
+    data(NULL),
+    size(0),
+    capacity(0) {
+    this->columns.resize(converters.size());
+
+    for (uint16_t i = 0, limiti = converters.size(); i < limiti; i++) {
+        column_t& column = this->columns[i];
+        column.name = result->column(i)->getName();
+        column.converter = converters[i];
+        column.type = ArrowWriter::type(converters[i]);
+        column.nulls = 0;
+        if (column.type == UTF8 || column.type == BINARY) {
+            column.offsets.push_back(0);
+        }
+    }
+}
+
+node_db::ArrowWriter::~ArrowWriter() {
+    free(this->data);
+}
+
+node_db::ArrowWriter::type_t node_db::ArrowWriter::type(node_db::ConversionPlan::converter_t converter) {
+    switch (converter) {
+        case node_db::ConversionPlan::BOOL:
+            return BOOLEAN;
+        case node_db::ConversionPlan::INT:
+        case node_db::ConversionPlan::BIGINT:
+            return INT64;
+        case node_db::ConversionPlan::NUMBER:
+            return FLOAT64;
+        case node_db::ConversionPlan::TIME:
+        case node_db::ConversionPlan::DATE:
+        case node_db::ConversionPlan::DATETIME:
+            return TIMESTAMP;
+        case node_db::ConversionPlan::BUFFER:
+            return BINARY;
+        default:
+            return UTF8;
+    }
+}
+
+void node_db::ArrowWriter::row(char** columns, unsigned long* columnLengths, const node_db::ConversionPlan::number_t* numbers) throw(node_db::Exception&) {
+    int64_t index = this->rows++;
+
+    for (uint16_t i = 0, limiti = this->columns.size(); i < limiti; i++) {
+        column_t& column = this->columns[i];
+        const char* value = columns[i];
+        const node_db::ConversionPlan::number_t* number = (numbers != NULL ? &numbers[i] : NULL);
+        bool valid = (value != NULL);
+
+        if (index % 8 == 0) {
+            column.validity.push_back(0);
+            if (column.type == BOOLEAN) {
+                column.values.push_back(0);
+            }
+        }
+
+        switch (column.type) {
+            case INT64:
+            case TIMESTAMP:
+                {
+                    // Values the worker could not decode are delivered as NULL
+                    int64_t integer = 0;
+                    if (valid && number == NULL) {
+                        valid = false;
+                    } else if (valid && column.converter == node_db::ConversionPlan::BIGINT) {
+                        valid = (number->integer != static_cast<int64_t>(static_cast<uint64_t>(1) << 63));
+                        integer = number->integer;
+                    } else if (valid) {
+                        // NaN and values out of int64_t range alike
+                        valid = (number->real >= -9223372036854775808.0 && number->real < 9223372036854775808.0);
+                        integer = (valid ? static_cast<int64_t>(number->real) : 0);
+                    }
+                    const char* bytes = reinterpret_cast<const char*>(&integer);
+                    column.values.insert(column.values.end(), bytes, bytes + sizeof(integer));
+                }
+                break;
+            case FLOAT64:
+                {
+                    double real = 0;
+                    if (valid && number != NULL) {
+                        real = number->real;
+                    } else {
+                        valid = false;
+                    }
+                    const char* bytes = reinterpret_cast<const char*>(&real);
+                    column.values.insert(column.values.end(), bytes, bytes + sizeof(real));
+                }
+                break;
+            case BOOLEAN:
+                if (valid && (columnLengths[i] == 0 || value[0] != '0')) {
+                    column.values[index >> 3] |= static_cast<uint8_t>(1 << (index & 7));
+                }
+                break;
+            default:
+                if (valid) {
+                    if (column.values.size() + columnLengths[i] > 0x7fffffff) {
+                        throw node_db::Exception("Column too large for an Arrow record batch");
+                    }
+                    column.values.insert(column.values.end(), value, value + columnLengths[i]);
+                }
+                column.offsets.push_back(static_cast<int32_t>(column.values.size()));
+                break;
+        }
+
+        if (valid) {
+            column.validity[index >> 3] |= static_cast<uint8_t>(1 << (index & 7));
+        } else {
+            column.nulls++;
+        }
+    }
+}
+
+void node_db::ArrowWriter::flush(bool last) throw(node_db::Exception&) {
+    if (!this->started) {
+        if (this->file) {
+            this->append(arrowMagic, sizeof(arrowMagic));
+        }
+        this->writeSchema();
+        this->started = true;
+    }
+
+    if (this->rows > 0) {
+        this->writeBatch();
+    }
+
+    if (last) {
+        if (this->file) {
+            this->writeFooter();
+        } else {
+            const uint32_t end[2] = { 0xFFFFFFFF, 0 };
+            this->append(end, sizeof(end));
+        }
+    }
+}
+
+char* node_db::ArrowWriter::release(size_t* length) {
+    char* data = this->data;
+    *length = this->size;
+
+    this->data = NULL;
+    this->size = 0;
+    this->capacity = 0;
+
+    return data;
+}
+
+size_t node_db::ArrowWriter::schema(FlatBuilder* builder) const {
+    // Schema { endianness: short, fields: [Field] }
+    const uint8_t sizes[] = { 2, 4 };
+    size_t positions[2];
+    size_t schema = builder->table(sizes, 2, positions);
+    builder->scalar<int16_t>(positions[0], 0);
+
+    size_t fields = builder->vector(this->columns.size(), 4, 4);
+    builder->offset(positions[1], fields - 4);
+
+    for (uint16_t i = 0, limiti = this->columns.size(); i < limiti; i++) {
+        builder->offset(fields + 4 * i, this->field(builder, this->columns[i]));
+    }
+
+    return schema;
+}
+
+size_t node_db::ArrowWriter::field(FlatBuilder* builder, const column_t& column) const {
+    // Field { name: string, nullable: bool, type_type: ubyte, type: Type,
+    // dictionary: DictionaryEncoding, children: [Field] }
+    const uint8_t sizes[] = { 4, 1, 1, 4, 0, 4 };
+    size_t positions[6];
+    size_t field = builder->table(sizes, 6, positions);
+    builder->scalar<uint8_t>(positions[1], 1);
+
+    builder->offset(positions[0], builder->string(column.name));
+
+    uint8_t typeType;
+    size_t type;
+    switch (column.type) {
+        case INT64:
+            {
+                const uint8_t typeSizes[] = { 4, 1 };
+                size_t typePositions[2];
+                typeType = ARROW_TYPE_INT;
+                type = builder->table(typeSizes, 2, typePositions);
+                builder->scalar<int32_t>(typePositions[0], 64);
+                builder->scalar<uint8_t>(typePositions[1], 1);
+            }
+            break;
+        case FLOAT64:
+            {
+                const uint8_t typeSizes[] = { 2 };
+                size_t typePositions[1];
+                typeType = ARROW_TYPE_FLOATING_POINT;
+                type = builder->table(typeSizes, 1, typePositions);
+                builder->scalar<int16_t>(typePositions[0], ARROW_PRECISION_DOUBLE);
+            }
+            break;
+        case TIMESTAMP:
+            {
+                // JS timestamps: milliseconds since the epoch, in UTC
+                const uint8_t typeSizes[] = { 2, 4 };
+                size_t typePositions[2];
+                typeType = ARROW_TYPE_TIMESTAMP;
+                type = builder->table(typeSizes, 2, typePositions);
+                builder->scalar<int16_t>(typePositions[0], ARROW_TIME_UNIT_MILLISECOND);
+                builder->offset(typePositions[1], builder->string("UTC"));
+            }
+            break;
+        default:
+            typeType = (column.type == BOOLEAN ? ARROW_TYPE_BOOL : (column.type == BINARY ? ARROW_TYPE_BINARY : ARROW_TYPE_UTF8));
+            type = builder->table(NULL, 0, NULL);
+            break;
+    }
+    builder->scalar<uint8_t>(positions[2], typeType);
+    builder->offset(positions[3], type);
+
+    size_t children = builder->vector(0, 4, 4);
+    builder->offset(positions[5], children - 4);
+
+    return field;
+}
+
+void node_db::ArrowWriter::message(uint8_t header, const std::string& metadata, int64_t bodyLength, block_t* block) throw(node_db::Exception&) {
+    const uint32_t prefix[2] = { 0xFFFFFFFF, static_cast<uint32_t>(metadata.size()) };
+
+    if (block != NULL) {
+        block->offset = this->position;
+        block->metadataLength = sizeof(prefix) + metadata.size();
+        block->bodyLength = bodyLength;
+    }
+
+    this->append(prefix, sizeof(prefix));
+    this->append(metadata.data(), metadata.size());
+}
+
+void node_db::ArrowWriter::writeSchema() throw(node_db::Exception&) {
+    // Message { version: short, header_type: ubyte, header: MessageHeader,
+    // bodyLength: long }
+    const uint8_t sizes[] = { 2, 1, 4, 8 };
+    size_t positions[4];
+    FlatBuilder builder;
+
+    size_t message = builder.table(sizes, 4, positions);
+    builder.root(message);
+    builder.scalar<int16_t>(positions[0], ARROW_METADATA_V5);
+    builder.scalar<uint8_t>(positions[1], ARROW_HEADER_SCHEMA);
+    builder.scalar<int64_t>(positions[3], 0);
+    builder.offset(positions[2], this->schema(&builder));
+
+    this->message(ARROW_HEADER_SCHEMA, builder.finish(), 0, NULL);
+}
+
+void node_db::ArrowWriter::writeBatch() throw(node_db::Exception&) {
+    std::vector<const void*> buffers;
+    std::vector<int64_t> lengths;
+    int64_t bitmapLength = (this->rows + 7) / 8;
+
+    for (std::vector<column_t>::iterator column = this->columns.begin(), end = this->columns.end(); column != end; ++column) {
+        // Columns without NULLs leave their validity buffer empty
+        buffers.push_back(&(column->validity[0]));
+        lengths.push_back(column->nulls > 0 ? bitmapLength : 0);
+
+        if (column->type == UTF8 || column->type == BINARY) {
+            buffers.push_back(&(column->offsets[0]));
+            lengths.push_back((this->rows + 1) * sizeof(int32_t));
+        }
+
+        buffers.push_back(column->values.empty() ? NULL : &(column->values[0]));
+        lengths.push_back(column->values.size());
+    }
+
+    // RecordBatch { length: long, nodes: [FieldNode], buffers: [Buffer] }
+    const uint8_t sizes[] = { 2, 1, 4, 8 };
+    const uint8_t batchSizes[] = { 8, 4, 4 };
+    size_t positions[4], batchPositions[3];
+    FlatBuilder builder;
+
+    size_t message = builder.table(sizes, 4, positions);
+    builder.root(message);
+    builder.scalar<int16_t>(positions[0], ARROW_METADATA_V5);
+    builder.scalar<uint8_t>(positions[1], ARROW_HEADER_RECORD_BATCH);
+
+    size_t batch = builder.table(batchSizes, 3, batchPositions);
+    builder.offset(positions[2], batch);
+    builder.scalar<int64_t>(batchPositions[0], this->rows);
+
+    size_t nodes = builder.vector(this->columns.size(), 16, 8);
+    builder.offset(batchPositions[1], nodes - 4);
+    for (uint16_t i = 0, limiti = this->columns.size(); i < limiti; i++) {
+        builder.scalar<int64_t>(nodes + 16 * i, this->rows);
+        builder.scalar<int64_t>(nodes + 16 * i + 8, this->columns[i].nulls);
+    }
+
+    size_t descriptors = builder.vector(buffers.size(), 16, 8);
+    builder.offset(batchPositions[2], descriptors - 4);
+    int64_t bodyLength = 0;
+    for (size_t i = 0, limiti = buffers.size(); i < limiti; i++) {
+        builder.scalar<int64_t>(descriptors + 16 * i, bodyLength);
+        builder.scalar<int64_t>(descriptors + 16 * i + 8, lengths[i]);
+        bodyLength += (lengths[i] + 7) & ~static_cast<int64_t>(7);
+    }
+    builder.scalar<int64_t>(positions[3], bodyLength);
+
+    block_t block;
+    this->message(ARROW_HEADER_RECORD_BATCH, builder.finish(), bodyLength, &block);
+    this->blocks.push_back(block);
+
+    for (size_t i = 0, limiti = buffers.size(); i < limiti; i++) {
+        if (lengths[i] > 0) {
+            this->append(buffers[i], lengths[i]);
+            this->pad(8);
+        }
+    }
+
+    // The next batch starts with empty buffers
+    this->rows = 0;
+    for (std::vector<column_t>::iterator column = this->columns.begin(), end = this->columns.end(); column != end; ++column) {
+        column->validity.clear();
+        column->values.clear();
+        column->nulls = 0;
+        if (!column->offsets.empty()) {
+            column->offsets.resize(1);
+        }
+    }
+}
+
+void node_db::ArrowWriter::writeFooter() throw(node_db::Exception&) {
+    // Footer { version: short, schema: Schema, dictionaries: [Block],
+    // recordBatches: [Block] }
+    const uint8_t sizes[] = { 2, 4, 4, 4 };
+    size_t positions[4];
+    FlatBuilder builder;
+
+    size_t footer = builder.table(sizes, 4, positions);
+    builder.root(footer);
+    builder.scalar<int16_t>(positions[0], ARROW_METADATA_V5);
+    builder.offset(positions[1], this->schema(&builder));
+
+    size_t dictionaries = builder.vector(0, 24, 8);
+    builder.offset(positions[2], dictionaries - 4);
+
+    size_t blocks = builder.vector(this->blocks.size(), 24, 8);
+    builder.offset(positions[3], blocks - 4);
+    for (size_t i = 0, limiti = this->blocks.size(); i < limiti; i++) {
+        builder.scalar<int64_t>(blocks + 24 * i, this->blocks[i].offset);
+        builder.scalar<int32_t>(blocks + 24 * i + 8, this->blocks[i].metadataLength);
+        builder.scalar<int64_t>(blocks + 24 * i + 16, this->blocks[i].bodyLength);
+    }
+
+    const std::string& metadata = builder.finish();
+    int32_t length = metadata.size();
+    this->append(metadata.data(), metadata.size());
+    this->append(&length, sizeof(length));
+    this->append(arrowMagic, 6);
+}
+
+void node_db::ArrowWriter::append(const void* value, size_t length) throw(node_db::Exception&) {
+    this->reserve(length);
+    memcpy(this->data + this->size, value, length);
+    this->size += length;
+    this->position += length;
+}
+
+void node_db::ArrowWriter::pad(size_t alignment) throw(node_db::Exception&) {
+    static const char zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    size_t padding = (alignment - this->position % alignment) % alignment;
+    if (padding > 0) {
+        this->append(zeros, padding);
+    }
+}
+
+void node_db::ArrowWriter::reserve(size_t length) throw(node_db::Exception&) {
+    if (this->size + length <= this->capacity) {
+        return;
+    }
+
+    size_t capacity = (this->capacity > 0 ? this->capacity * 2 : 64 * 1024);
+    while (capacity < this->size + length) {
+        capacity *= 2;
+    }
+
+    char* data = static_cast<char*>(realloc(this->data, capacity));
+    if (data == NULL) {
+        throw node_db::Exception("Could not allocate memory for Arrow output");
+    }
+
+    this->data = data;
+    this->capacity = capacity;
+}
+
+node_db::ArrowWriter::FlatBuilder::FlatBuilder()
+    :buffer(4, '\0') {
+}
+
+// Lays out a table whose fields have the given inline sizes (0 for absent
+// ones), preceded by its vtable, and returns where each field went
+size_t node_db::ArrowWriter::FlatBuilder::table(const uint8_t* sizes, uint16_t count, size_t* positions) {
+    std::vector<uint16_t> offsets(count, 0);
+    size_t tableSize = 4, alignment = 4;
+
+    for (size_t size = 8; size > 0; size >>= 1) {
+        for (uint16_t i = 0; i < count; i++) {
+            if (sizes[i] == size) {
+                tableSize = (tableSize + size - 1) & ~(size - 1);
+                offsets[i] = tableSize;
+                tableSize += size;
+                if (size > alignment) {
+                    alignment = size;
+                }
+            }
+        }
+    }
+    tableSize = (tableSize + alignment - 1) & ~(alignment - 1);
+
+    this->pad(2);
+    size_t vtable = this->buffer.size();
+    uint16_t header[2] = { static_cast<uint16_t>(4 + 2 * count), static_cast<uint16_t>(tableSize) };
+    this->buffer.append(reinterpret_cast<const char*>(header), sizeof(header));
+    if (count > 0) {
+        this->buffer.append(reinterpret_cast<const char*>(&offsets[0]), 2 * count);
+    }
+
+    this->pad(alignment);
+    size_t table = this->buffer.size();
+    this->buffer.append(tableSize, '\0');
+    this->scalar<int32_t>(table, static_cast<int32_t>(table - vtable));
+
+    for (uint16_t i = 0; i < count; i++) {
+        positions[i] = (offsets[i] > 0 ? table + offsets[i] : 0);
+    }
+
+    return table;
+}
+
+// Returns where the elements start; the vector itself is 4 bytes before
+size_t node_db::ArrowWriter::FlatBuilder::vector(uint32_t count, size_t elementSize, size_t alignment) {
+    while ((this->buffer.size() + 4) % alignment != 0) {
+        this->buffer.push_back('\0');
+    }
+
+    this->buffer.append(reinterpret_cast<const char*>(&count), sizeof(count));
+    size_t elements = this->buffer.size();
+    this->buffer.append(count * elementSize, '\0');
+
+    return elements;
+}
+
+size_t node_db::ArrowWriter::FlatBuilder::string(const std::string& value) {
+    this->pad(4);
+    size_t string = this->buffer.size();
+    uint32_t length = value.size();
+
+    this->buffer.append(reinterpret_cast<const char*>(&length), sizeof(length));
+    this->buffer.append(value);
+    this->buffer.push_back('\0');
+
+    return string;
+}
+
+void node_db::ArrowWriter::FlatBuilder::offset(size_t at, size_t target) {
+    this->scalar<uint32_t>(at, static_cast<uint32_t>(target - at));
+}
+
+void node_db::ArrowWriter::FlatBuilder::root(size_t table) {
+    this->offset(0, table);
+}
+
+const std::string& node_db::ArrowWriter::FlatBuilder::finish() {
+    this->pad(8);
+    return this->buffer;
+}
+
+void node_db::ArrowWriter::FlatBuilder::pad(size_t alignment) {
+    while (this->buffer.size() % alignment != 0) {
+        this->buffer.push_back('\0');
+    }
+}
+
+#undef ARROW_METADATA_V5
+#undef ARROW_HEADER_SCHEMA
+#undef ARROW_HEADER_RECORD_BATCH
+#undef ARROW_TYPE_INT
+#undef ARROW_TYPE_FLOATING_POINT
+#undef ARROW_TYPE_BINARY
+#undef ARROW_TYPE_UTF8
+#undef ARROW_TYPE_BOOL
+#undef ARROW_TYPE_TIMESTAMP
+#undef ARROW_PRECISION_DOUBLE
+#undef ARROW_TIME_UNIT_MILLISECOND
@@ -0,0 +1,98 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef ARROW_H_
+#define ARROW_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "./exception.h"
+#include "./plan.h"
+#include "./result.h"
+
+namespace node_db {
+// Writes fetched rows as Apache Arrow IPC, in the stream format or in the
+// file format, on the worker thread. Rows are transposed into column
+// buffers as they are added, and every flush emits the rows added since
+// the previous one as a record batch. The first flush also starts with
+// the schema, and the last one closes the stream or writes the file
+// footer, so all flushed chunks concatenate into one valid stream or file.
+class ArrowWriter {
+    public:
+        ArrowWriter(Result* result, const std::vector<ConversionPlan::converter_t>& converters, bool file);
+        ~ArrowWriter();
+        void row(char** columns, unsigned long* columnLengths, const ConversionPlan::number_t* numbers) throw(Exception&);
+        void flush(bool last) throw(Exception&);
+        char* release(size_t* length);
+
+    protected:
+        typedef enum {
+            INT64,
+            FLOAT64,
+            TIMESTAMP,
+            BOOLEAN,
+            UTF8,
+            BINARY
+        } type_t;
+        struct column_t {
+            std::string name;
+            ConversionPlan::converter_t converter;
+            type_t type;
+            std::vector<uint8_t> validity;
+            std::vector<char> values;
+            std::vector<int32_t> offsets;
+            int64_t nulls;
+        };
+        struct block_t {
+            int64_t offset;
+            int32_t metadataLength;
+            int64_t bodyLength;
+        };
+        // Just enough of a FlatBuffers builder for Arrow metadata. Objects
+        // are laid out front to back, so a table is written before the
+        // strings, vectors and tables it points to, and its offsets are
+        // filled in once those exist.
+        class FlatBuilder {
+            public:
+                FlatBuilder();
+                size_t table(const uint8_t* sizes, uint16_t count, size_t* positions);
+                size_t vector(uint32_t count, size_t elementSize, size_t alignment);
+                size_t string(const std::string& value);
+                void offset(size_t at, size_t target);
+                void root(size_t table);
+                template <class T> void scalar(size_t at, T value) {
+                    memcpy(&(this->buffer[at]), &value, sizeof(T));
+                }
+                const std::string& finish();
+
+            protected:
+                std::string buffer;
+
+                void pad(size_t alignment);
+        };
+
+        std::vector<column_t> columns;
+        std::vector<block_t> blocks;
+        bool file;
+        bool started;
+        int64_t rows;
+        uint64_t position;
+        char* data;
+        size_t size;
+        size_t capacity;
+
+        static type_t type(ConversionPlan::converter_t converter);
+        size_t schema(FlatBuilder* builder) const;
+        size_t field(FlatBuilder* builder, const column_t& column) const;
+        void message(uint8_t header, const std::string& metadata, int64_t bodyLength, block_t* block) throw(Exception&);
+        void writeSchema() throw(Exception&);
+        void writeBatch() throw(Exception&);
+        void writeFooter() throw(Exception&);
+        void append(const void* value, size_t length) throw(Exception&);
+        void pad(size_t alignment) throw(Exception&);
+        void reserve(size_t length) throw(Exception&);
+};
+}
+
+#endif  // ARROW_H_
@@ -0,0 +1,222 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+//
+// Reads the rows of a stub driver the way Query::fetchRows does, once through
+// the virtual per-row interface and once through ResultAdapter, and prints
+// how long each took. The stub is unbuffered and reuses one row buffer, like
+// a driver streaming off the wire. From the top of the tree:
+//
+//   g++ -O2 -I. -o adapter benchmark/adapter.cc arena.cc exception.cc result.cc
+//   ./adapter [rows] [columns]
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <vector>
+#include "./adapter.h"
+#include "./arena.h"
+#include "./result.h"
+
+namespace {
+class StubColumn : public node_db::Result::Column {
+    public:
+        std::string getName() const {
+            return "value";
+        }
+        type_t getType() const {
+            return STRING;
+        }
+};
+
+// The rows both results hand out: every cell holds the row number as text
+class StubRows {
+    public:
+        StubRows(uint64_t rows, uint16_t columnCount)
+            :rows(rows),
+            current(0),
+            columns(columnCount),
+            lengths(columnCount) {
+            for (uint16_t i = 0; i < columnCount; i++) {
+                this->columns[i] = this->text + i % 2;
+            }
+        }
+        bool hasNext() const {
+            return this->current < this->rows;
+        }
+        char** next() {
+            char digits[20];
+            char* start = digits + sizeof(digits);
+            uint64_t value = this->current++;
+            do {
+                *--start = static_cast<char>('0' + value % 10);
+                value /= 10;
+            } while (value > 0);
+
+            unsigned long length = digits + sizeof(digits) - start;
+            memcpy(this->text, start, length);
+            for (std::vector<unsigned long>::size_type i = 0, limiti = this->lengths.size(); i < limiti; i++) {
+                this->lengths[i] = length - i % 2;
+            }
+            return &(this->columns[0]);
+        }
+        unsigned long* columnLengths() {
+            return &(this->lengths[0]);
+        }
+
+        uint64_t rows;
+        uint64_t current;
+        std::vector<char*> columns;
+        std::vector<unsigned long> lengths;
+        char text[24];
+};
+
+class VirtualResult : public node_db::Result {
+    public:
+        VirtualResult(uint64_t rows, uint16_t columnCount) : stub(rows, columnCount) {}
+        bool hasNext() const throw(node_db::Exception&) { return this->stub.hasNext(); }
+        char** next() throw(node_db::Exception&) { return this->stub.next(); }
+        unsigned long* columnLengths() throw(node_db::Exception&) { return this->stub.columnLengths(); }
+        uint64_t index() const throw(std::out_of_range&) { return this->stub.current; }
+        Column* column(uint16_t) const throw(std::out_of_range&) { return const_cast<StubColumn*>(&(this->stubColumn)); }
+        uint64_t affectedCount() const throw() { return 0; }
+        uint16_t columnCount() const throw() { return this->stub.columns.size(); }
+        bool isBuffered() const throw() { return false; }
+        bool isEmpty() const throw() { return false; }
+
+    protected:
+        mutable StubRows stub;
+        StubColumn stubColumn;
+};
+
+class AdaptedResult : public node_db::ResultAdapter<AdaptedResult> {
+    public:
+        AdaptedResult(uint64_t rows, uint16_t columnCount) : stub(rows, columnCount) {}
+        bool hasNext() const throw(node_db::Exception&) { return this->stub.hasNext(); }
+        char** next() throw(node_db::Exception&) { return this->stub.next(); }
+        unsigned long* columnLengths() throw(node_db::Exception&) { return this->stub.columnLengths(); }
+        uint64_t index() const throw(std::out_of_range&) { return this->stub.current; }
+        Column* column(uint16_t) const throw(std::out_of_range&) { return const_cast<StubColumn*>(&(this->stubColumn)); }
+        uint64_t affectedCount() const throw() { return 0; }
+        uint16_t columnCount() const throw() { return this->stub.columns.size(); }
+        bool isBuffered() const throw() { return false; }
+        bool isEmpty() const throw() { return false; }
+
+    protected:
+        mutable StubRows stub;
+        StubColumn stubColumn;
+};
+
+struct row_t {
+    char** columns;
+    unsigned long* columnLengths;
+};
+
+double now() {
+    struct timeval time;
+    gettimeofday(&time, NULL);
+    return time.tv_sec * 1000.0 + time.tv_usec / 1000.0;
+}
+
+// Both paths read like a stream does: up to 1024 rows into the arena, which
+// is cleared before the next ones, so memory stays warm and what is left is
+// the cost of getting rows out of the driver.
+const size_t chunkRows = 1024;
+
+// One row per round of virtual calls, copied into the arena
+size_t readRows(node_db::Result* result, node_db::Arena* arena, std::vector<row_t*>* rows) {
+    uint16_t columnCount = result->columnCount();
+    size_t bytes = 0;
+
+    while (result->hasNext()) {
+        arena->clear();
+        rows->clear();
+
+        while (rows->size() < chunkRows && result->hasNext()) {
+            unsigned long* cellLengths = result->columnLengths();
+            char** cells = result->next();
+
+            row_t* row = arena->allocate<row_t>(1);
+            row->columnLengths = arena->allocate<unsigned long>(columnCount);
+            memcpy(row->columnLengths, cellLengths, columnCount * sizeof(unsigned long));
+            row->columns = arena->allocate<char*>(columnCount);
+            for (uint16_t i = 0; i < columnCount; i++) {
+                row->columns[i] = arena->allocate<char>(row->columnLengths[i]);
+                memcpy(row->columns[i], cells[i], row->columnLengths[i]);
+                bytes += row->columnLengths[i];
+            }
+            rows->push_back(row);
+        }
+    }
+
+    return bytes;
+}
+
+// Up to 1024 rows per virtual call, already in the arena
+size_t readBatches(node_db::Result* result, node_db::Arena* arena, std::vector<row_t*>* rows) {
+    uint16_t columnCount = result->columnCount();
+    node_db::RowBatch batch(columnCount, arena, true);
+    size_t bytes = 0;
+
+    for (;;) {
+        arena->clear();
+        rows->clear();
+        batch.clear();
+
+        size_t count = result->fetchBatch(batch, chunkRows);
+        if (count == 0) {
+            break;
+        }
+
+        for (size_t r = 0; r < count; r++) {
+            row_t* row = arena->allocate<row_t>(1);
+            row->columns = batch.columns(r);
+            row->columnLengths = batch.columnLengths(r);
+            for (uint16_t i = 0; i < columnCount; i++) {
+                bytes += row->columnLengths[i];
+            }
+            rows->push_back(row);
+        }
+    }
+
+    return bytes;
+}
+}
+
+int main(int argc, char** argv) {
+    uint64_t rowCount = (argc > 1 ? strtoull(argv[1], NULL, 10) : 2000000);
+    uint16_t columnCount = static_cast<uint16_t>(argc > 2 ? atoi(argv[2]) : 8);
+    const int rounds = 15;
+    double best[2] = { 0, 0 };
+    size_t bytes[2] = { 0, 0 };
+
+    for (int round = 0; round < rounds; round++) {
+        for (int adapted = 0; adapted < 2; adapted++) {
+            node_db::Result* result = (adapted
+                ? static_cast<node_db::Result*>(new AdaptedResult(rowCount, columnCount))
+                : static_cast<node_db::Result*>(new VirtualResult(rowCount, columnCount)));
+            node_db::Arena arena;
+            std::vector<row_t*> rows;
+            rows.reserve(chunkRows);
+
+            double start = now();
+            bytes[adapted] = (adapted ? readBatches(result, &arena, &rows) : readRows(result, &arena, &rows));
+            double elapsed = now() - start;
+
+            if (round == 0 || elapsed < best[adapted]) {
+                best[adapted] = elapsed;
+            }
+            delete result;
+        }
+    }
+
+    if (bytes[0] != bytes[1]) {
+        fprintf(stderr, "Paths read different data: %lu and %lu bytes\n", static_cast<unsigned long>(bytes[0]), static_cast<unsigned long>(bytes[1]));
+        return 1;
+    }
+
+    printf("%llu rows of %u columns, best of %d\n", static_cast<unsigned long long>(rowCount), columnCount, rounds);
+    printf("virtual:  %8.1f ms\n", best[0]);
+    printf("adapter:  %8.1f ms\n", best[1]);
+    printf("speedup:  %8.2fx\n", best[0] / best[1]);
+    return 0;
+}
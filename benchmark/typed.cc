@@ -0,0 +1,185 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+//
+// Reads one row of typed cells from a stub driver through ResultAdapter and
+// converts every cell the way Query::fetchRows does: into the side buffer
+// when its converter takes the value as it is, into text otherwise. Prints
+// every cell that didn't come out as expected. From the top of the tree:
+//
+//   g++ -I. -o typed benchmark/typed.cc arena.cc conversion.cc date.cc exception.cc result.cc -lpthread
+//   ./typed
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "./adapter.h"
+#include "./arena.h"
+#include "./conversion.h"
+#include "./date.h"
+#include "./result.h"
+
+namespace {
+// A typed cell, what it is converted with, and what should come out: the
+// number assign() fills in, or the text format() writes when text is NULL
+struct cell_t {
+    node_db::Result::Column::type_t type;
+    node_db::Conversion::converter_t converter;
+    node_db::TypedValue value;
+    double real;
+    const char* text;
+};
+
+node_db::TypedValue typedInteger(int64_t integer) {
+    node_db::TypedValue value;
+    value.type = node_db::TypedValue::INT64;
+    value.value.integer = integer;
+    return value;
+}
+
+node_db::TypedValue typedReal(double real) {
+    node_db::TypedValue value;
+    value.type = node_db::TypedValue::DOUBLE;
+    value.value.real = real;
+    return value;
+}
+
+node_db::TypedValue typedTimestamp(int64_t micros) {
+    node_db::TypedValue value;
+    value.type = node_db::TypedValue::TIMESTAMP;
+    value.value.micros = micros;
+    return value;
+}
+
+node_db::TypedValue typedBoolean(bool boolean) {
+    node_db::TypedValue value;
+    value.type = node_db::TypedValue::BOOLEAN;
+    value.value.boolean = boolean;
+    return value;
+}
+
+class StubColumn : public node_db::Result::Column {
+    public:
+        explicit StubColumn(type_t type) : type(type) {}
+        std::string getName() const {
+            return "value";
+        }
+        type_t getType() const {
+            return this->type;
+        }
+
+    protected:
+        type_t type;
+};
+
+// Hands out a single row with one typed cell per case and no text, the way
+// a driver reading a binary protocol does
+class StubResult : public node_db::ResultAdapter<StubResult> {
+    public:
+        explicit StubResult(const std::vector<cell_t>& cells) : done(false), columns(cells.size()), lengths(cells.size(), 0) {
+            for (std::vector<cell_t>::size_type i = 0, limiti = cells.size(); i < limiti; i++) {
+                this->stubColumns.push_back(StubColumn(cells[i].type));
+                this->typedValues.push_back(cells[i].value);
+                this->columns[i] = this->text;
+            }
+        }
+        bool hasNext() const throw(node_db::Exception&) { return !this->done; }
+        char** next() throw(node_db::Exception&) { this->done = true; return &(this->columns[0]); }
+        unsigned long* columnLengths() throw(node_db::Exception&) { return &(this->lengths[0]); }
+        uint64_t index() const throw(std::out_of_range&) { return 0; }
+        Column* column(uint16_t i) const throw(std::out_of_range&) { return const_cast<StubColumn*>(&(this->stubColumns.at(i))); }
+        uint64_t affectedCount() const throw() { return 0; }
+        uint16_t columnCount() const throw() { return this->columns.size(); }
+        bool isBuffered() const throw() { return false; }
+        bool isEmpty() const throw() { return false; }
+        bool isTyped() const throw() { return true; }
+        const node_db::TypedValue* values() throw(node_db::Exception&) { return &(this->typedValues[0]); }
+
+    protected:
+        bool done;
+        std::vector<char*> columns;
+        std::vector<unsigned long> lengths;
+        std::vector<StubColumn> stubColumns;
+        std::vector<node_db::TypedValue> typedValues;
+        char text[1];
+};
+
+void addCell(std::vector<cell_t>* cells, node_db::Result::Column::type_t type, node_db::Conversion::converter_t converter,
+    const node_db::TypedValue& value, double real, const char* text) {
+    cell_t cell;
+    cell.type = type;
+    cell.converter = converter;
+    cell.value = value;
+    cell.real = real;
+    cell.text = text;
+    cells->push_back(cell);
+}
+}
+
+int main() {
+    typedef node_db::Result::Column Column;
+    typedef node_db::Conversion Conversion;
+    std::vector<cell_t> cells;
+
+    // Values converters take as they are
+    addCell(&cells, Column::INT, Conversion::INT, typedInteger(-42), -42, NULL);
+    addCell(&cells, Column::BIGINT, Conversion::BIGINT, typedInteger(9007199254740991LL), 9007199254740991.0, NULL);
+    addCell(&cells, Column::NUMBER, Conversion::NUMBER, typedReal(0.1), 0.1, NULL);
+    addCell(&cells, Column::DATETIME, Conversion::DATETIME, typedTimestamp(1500000000123456LL), 1500000000123.456, NULL);
+    addCell(&cells, Column::BOOL, Conversion::INT, typedBoolean(true), 1, NULL);
+
+    // Values converted as text after all: casting is off, or a BIGINT JS
+    // can't hold
+    addCell(&cells, Column::INT, Conversion::STRING, typedInteger(-42), 0, "-42");
+    addCell(&cells, Column::BIGINT, Conversion::BIGINT, typedInteger(-9007199254740993LL), 0, "-9007199254740993");
+    addCell(&cells, Column::NUMBER, Conversion::STRING, typedReal(0.1), 0, "0.1");
+    addCell(&cells, Column::NUMBER, Conversion::STRING, typedReal(1.0 / 3), 0, "0.3333333333333333");
+    addCell(&cells, Column::NUMBER, Conversion::STRING, typedReal(0.1 + 0.2), 0, "0.30000000000000004");
+    addCell(&cells, Column::DATETIME, Conversion::STRING, typedTimestamp(1500000000123456LL), 0, "2017-07-14 02:40:00.123456");
+    addCell(&cells, Column::DATETIME, Conversion::STRING, typedTimestamp(-1), 0, "1969-12-31 23:59:59.999999");
+    addCell(&cells, Column::DATE, Conversion::STRING, typedTimestamp(1500000000123456LL), 0, "2017-07-14");
+    addCell(&cells, Column::TIME, Conversion::STRING, typedTimestamp(-3723500000LL), 0, "-01:02:03.500000");
+    addCell(&cells, Column::BOOL, Conversion::STRING, typedBoolean(false), 0, "0");
+
+    StubResult result(cells);
+    node_db::Arena arena;
+    node_db::RowBatch batch(result.columnCount(), &arena, true);
+    node_db::DateCodec dates;
+
+    if (result.fetchBatch(batch, 1024) != 1 || batch.values(0) == NULL) {
+        fprintf(stderr, "The stub row came out without its typed values\n");
+        return 1;
+    }
+
+    const node_db::TypedValue* values = batch.values(0);
+    int failures = 0;
+    for (uint16_t i = 0; i < result.columnCount(); i++) {
+        const cell_t& cell = cells[i];
+        Conversion::number_t number;
+        bool assigned = (Conversion::assign(cell.converter, values[i], &number)
+            && (cell.converter != Conversion::BIGINT || Conversion::isSafeInteger(number.integer)));
+
+        if (cell.text == NULL) {
+            double real = (cell.converter == Conversion::BIGINT ? static_cast<double>(number.integer) : number.real);
+            if (!assigned || real != cell.real) {
+                fprintf(stderr, "cell %u: expected %.17g, got %s%.17g\n", i, cell.real, assigned ? "" : "no value, ", assigned ? real : 0.0);
+                failures++;
+            }
+            continue;
+        }
+
+        char text[64];
+        unsigned long length = (assigned ? 0 : Conversion::format(values[i], result.column(i)->getType(), &dates, text));
+        if (assigned || length != strlen(cell.text) || memcmp(text, cell.text, length) != 0) {
+            fprintf(stderr, "cell %u: expected \"%s\", got %s\"%.*s\"\n", i, cell.text, assigned ? "a value instead of " : "",
+                static_cast<int>(length), text);
+            failures++;
+        }
+    }
+
+    if (failures > 0) {
+        return 1;
+    }
+
+    printf("%u typed cells converted as expected\n", result.columnCount());
+    return 0;
+}
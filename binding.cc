@@ -1,18 +1,34 @@
 // Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
 #include "./binding.h"
 
-node_db::Binding::Binding(): node_db::EventEmitter(), connection(NULL), cbConnect(NULL) {
+node_db::Binding::Binding(): node_db::EventEmitter(), connection(NULL), cbConnect(NULL), pool(NULL) {
 }
 
 node_db::Binding::~Binding() {
     if (this->cbConnect != NULL) {
         delete this->cbConnect;
     }
+    if (this->pool != NULL) {
+        delete this->pool;
+    }
+}
+
+node_db::Connection* node_db::Binding::createConnection() const {
+    return NULL;
+}
+
+node_db::ConnectionPool* node_db::Binding::getPool() {
+    if (this->pool == NULL) {
+        this->pool = new node_db::ConnectionPool(this->connection, this);
+    }
+    return this->pool;
 }
 
 uv_async_t node_db::Binding::g_async;
 
 void node_db::Binding::Init(v8::Handle<v8::Object> target, v8::Local<v8::FunctionTemplate> constructorTemplate) {
+    node_db::EventEmitter::Init();
+
     NODE_ADD_CONSTANT(constructorTemplate, COLUMN_TYPE_STRING, node_db::Result::Column::STRING);
     NODE_ADD_CONSTANT(constructorTemplate, COLUMN_TYPE_BOOL, node_db::Result::Column::BOOL);
     NODE_ADD_CONSTANT(constructorTemplate, COLUMN_TYPE_INT, node_db::Result::Column::INT);
@@ -30,6 +46,7 @@ void node_db::Binding::Init(v8::Handle<v8::Object> target, v8::Local<v8::Functio
     NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "escape", Escape);
     NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "name", Name);
     NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "query", Query);
+    NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "stats", Stats);
 }
 
 NAN_METHOD(node_db::Binding::Connect) {
@@ -64,10 +81,46 @@ NAN_METHOD(node_db::Binding::Connect) {
             }
 
             ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, async);
+            ARG_CHECK_OBJECT_ATTR_OPTIONAL_UINT32(options, poolMin);
+            ARG_CHECK_OBJECT_ATTR_OPTIONAL_UINT32(options, poolMax);
+            ARG_CHECK_OBJECT_ATTR_OPTIONAL_STRING(options, engine);
 
             if (options->Has(async_key) && options->Get(async_key)->IsFalse()) {
                 async = false;
             }
+
+            if (options->Has(engine_key)) {
+                v8::String::Utf8Value engine(options->Get(engine_key)->ToString());
+                if (strcmp(*engine, "thread") == 0) {
+                    binding->getPool()->setEngine(node_db::ConnectionPool::THREAD);
+                } else if (strcmp(*engine, "threadpool") == 0) {
+                    binding->getPool()->setEngine(node_db::ConnectionPool::THREADPOOL);
+                } else {
+                    THROW_EXCEPTION("Option \"engine\" must be either \"thread\" or \"threadpool\"")
+                }
+            }
+
+            if (options->Has(poolMin_key) || options->Has(poolMax_key)) {
+                node_db::ConnectionPool* pool = binding->getPool();
+                uint32_t poolMin = pool->getMin(), poolMax = pool->getMax();
+
+                if (options->Has(poolMin_key)) {
+                    poolMin = options->Get(poolMin_key)->Uint32Value();
+                    if (!options->Has(poolMax_key) && poolMax < poolMin) {
+                        poolMax = poolMin;
+                    }
+                }
+
+                if (options->Has(poolMax_key)) {
+                    poolMax = options->Get(poolMax_key)->Uint32Value();
+                }
+
+                try {
+                    pool->setSize(poolMin, poolMax);
+                } catch(const node_db::Exception& exception) {
+                    THROW_EXCEPTION(exception.what())
+                }
+            }
         }
 
         if (callbackIndex >= 0) {
@@ -80,23 +133,32 @@ NAN_METHOD(node_db::Binding::Connect) {
         THROW_EXCEPTION("Could not create EIO request")
     }
 
+    try {
+        request->connections = binding->getPool()->fill();
+    } catch(const node_db::Exception& exception) {
+        delete request;
+        THROW_EXCEPTION(exception.what())
+    }
+
     NanAssignPersistent(v8::Object, request->context, args.This());
     request->binding = binding;
-    request->error = NULL;
+    request->pending = request->connections.size();
 
     if (async) {
         request->binding->Ref();
 
-        uv_work_t* req = new uv_work_t();
-        req->data = request;
-        uv_queue_work(uv_default_loop(), req, uvConnect, (uv_after_work_cb)uvConnectFinished);
-
 #if NODE_VERSION_AT_LEAST(0, 7, 9)
 	uv_ref((uv_handle_t *)&g_async);
 #else
 	uv_ref(uv_default_loop());
 #endif
 
+        for (std::vector<node_db::Connection*>::iterator iterator = request->connections.begin(), end = request->connections.end(); iterator != end; ++iterator) {
+            open_request_t* open = new open_request_t();
+            open->request = request;
+            open->connection = *iterator;
+            binding->getPool()->checkout(*iterator, connectCheckedOut, open);
+        }
     } else {
         connect(request);
         connectFinished(request);
@@ -106,10 +168,22 @@ NAN_METHOD(node_db::Binding::Connect) {
 }
 
 void node_db::Binding::connect(connect_request_t* request) {
-    try {
-        request->binding->connection->open();
-    } catch(node_db::Exception const& exception) {
-        request->error = exception.what();
+    node_db::ConnectionPool* pool = request->binding->getPool();
+
+    for (std::vector<node_db::Connection*>::iterator iterator = request->connections.begin(), end = request->connections.end(); iterator != end; ++iterator) {
+        if (!pool->tryCheckout(*iterator)) {
+            continue;
+        }
+
+        try {
+            (*iterator)->open();
+        } catch(node_db::Exception const& exception) {
+            if (request->error.empty()) {
+                request->error = exception.what();
+            }
+        }
+
+        pool->checkin(*iterator);
     }
 }
 
@@ -119,6 +193,8 @@ void node_db::Binding::connectFinished(connect_request_t* request) {
     bool connected = request->binding->connection->isAlive();
     v8::Local<v8::Value> argv[2];
 
+    request->binding->getPool()->setOpen(connected);
+
     if (connected) {
         v8::Local<v8::Object> server = v8::Object::New();
         server->Set(v8::String::New("version"), v8::String::New(request->binding->connection->version().c_str()));
@@ -131,7 +207,7 @@ void node_db::Binding::connectFinished(connect_request_t* request) {
 
         request->binding->Emit("ready", 1, &argv[1]);
     } else {
-        argv[0] = v8::String::New(request->error != NULL ? request->error : "(unknown error)");
+        argv[0] = v8::String::New(!request->error.empty() ? request->error.c_str() : "(unknown error)");
 
         request->binding->Emit("error", 1, argv);
     }
@@ -149,18 +225,42 @@ void node_db::Binding::connectFinished(connect_request_t* request) {
     delete request;
 }
 
-void node_db::Binding::uvConnect(uv_work_t* uvRequest) {
-    connect_request_t* request = static_cast<connect_request_t*>(uvRequest->data);
-    assert(request);
+void node_db::Binding::connectCheckedOut(node_db::Connection* connection, void* data) {
+    open_request_t* open = static_cast<open_request_t*>(data);
+    assert(open);
+
+    open->request->binding->getPool()->executor(connection)->submit(uvConnect, uvConnectFinished, open);
+}
+
+void node_db::Binding::uvConnect(void* data) {
+    open_request_t* open = static_cast<open_request_t*>(data);
+    assert(open);
 
-    connect(request);
+    try {
+        open->connection->open();
+    } catch(node_db::Exception const& exception) {
+        open->error = exception.what();
+    }
 }
 
-void node_db::Binding::uvConnectFinished(uv_work_t* uvRequest, int status) {
+void node_db::Binding::uvConnectFinished(void* data) {
     NanScope();
 
-    connect_request_t* request = static_cast<connect_request_t*>(uvRequest->data);
-    assert(request);
+    open_request_t* open = static_cast<open_request_t*>(data);
+    assert(open);
+
+    connect_request_t* request = open->request;
+
+    request->binding->getPool()->checkin(open->connection);
+    if (!open->error.empty() && request->error.empty()) {
+        request->error = open->error;
+    }
+
+    delete open;
+
+    if (--request->pending > 0) {
+        return;
+    }
 
 #if NODE_VERSION_AT_LEAST(0, 7, 9)
     uv_unref((uv_handle_t *)&g_async);
@@ -179,7 +279,7 @@ NAN_METHOD(node_db::Binding::Disconnect) {
     node_db::Binding* binding = node::ObjectWrap::Unwrap<node_db::Binding>(args.This());
     assert(binding);
 
-    binding->connection->close();
+    binding->getPool()->close();
 
     NanReturnValue(v8::Undefined());
 }
@@ -235,6 +335,27 @@ NAN_METHOD(node_db::Binding::Name) {
     NanReturnValue(v8::String::New(escaped.str().c_str()));
 }
 
+NAN_METHOD(node_db::Binding::Stats) {
+    NanScope();
+
+    node_db::Binding* binding = node::ObjectWrap::Unwrap<node_db::Binding>(args.This());
+    assert(binding);
+
+    node_db::ConnectionPool* pool = binding->getPool();
+    uint64_t wakeups = node_db::Executor::getWakeups();
+    uint64_t completions = node_db::Executor::getCompletions();
+
+    v8::Local<v8::Object> stats = v8::Object::New();
+    stats->Set(v8::String::New("connections"), v8::Integer::NewFromUnsigned(pool->size()));
+    stats->Set(v8::String::New("idle"), v8::Integer::NewFromUnsigned(pool->idleCount()));
+    stats->Set(v8::String::New("waiting"), v8::Integer::NewFromUnsigned(pool->waitingCount()));
+    stats->Set(v8::String::New("wakeups"), v8::Number::New(static_cast<double>(wakeups)));
+    stats->Set(v8::String::New("completions"), v8::Number::New(static_cast<double>(completions)));
+    stats->Set(v8::String::New("averageBatch"), v8::Number::New(wakeups > 0 ? static_cast<double>(completions) / wakeups : 0));
+
+    NanReturnValue(stats);
+}
+
 NAN_METHOD(node_db::Binding::Query) {
     NanScope();
 
@@ -248,6 +369,7 @@ NAN_METHOD(node_db::Binding::Query) {
 
     node_db::Query* queryInstance = node::ObjectWrap::Unwrap<node_db::Query>(query);
     queryInstance->setConnection(binding->connection);
+    queryInstance->setPool(binding->getPool());
 
     v8::Local<v8::Value> set = queryInstance->set(args);
     if (!set.IsEmpty()) {
@@ -7,24 +7,36 @@
 #include <node_buffer.h>
 #include <node_version.h>
 #include <string>
+#include <vector>
 #include "./node_defs.h"
 #include "./connection.h"
 #include "./events.h"
 #include "./exception.h"
+#include "./pool.h"
 #include "./query.h"
 
 namespace node_db {
-class Binding : public EventEmitter {
+class Binding : public EventEmitter, public ConnectionPool::Factory {
     public:
         Connection* connection;
 
+        virtual Connection* createConnection() const;
+
     protected:
         struct connect_request_t {
             v8::Persistent<v8::Object> context;
             Binding* binding;
-            const char* error;
+            std::vector<Connection*> connections;
+            uint32_t pending;
+            std::string error;
+        };
+        struct open_request_t {
+            connect_request_t* request;
+            Connection* connection;
+            std::string error;
         };
         NanCallback* cbConnect;
+        ConnectionPool* pool;
 
         Binding();
         ~Binding();
@@ -35,11 +47,14 @@ class Binding : public EventEmitter {
         static NAN_METHOD(Escape);
         static NAN_METHOD(Name);
         static NAN_METHOD(Query);
+        static NAN_METHOD(Stats);
 	static uv_async_t g_async;
-        static void uvConnect(uv_work_t* uvRequest);
-        static void uvConnectFinished(uv_work_t* uvRequest, int status);
+        static void connectCheckedOut(Connection* connection, void* data);
+        static void uvConnect(void* data);
+        static void uvConnectFinished(void* data);
         static void connect(connect_request_t* request);
         static void connectFinished(connect_request_t* request);
+        ConnectionPool* getPool();
         virtual v8::Handle<v8::Value> set(const v8::Local<v8::Object> options) = 0;
         virtual v8::Local<v8::Object> createQuery() const = 0;
 };
@@ -0,0 +1,125 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./conversion.h"
+
+bool node_db::Conversion::isSafeInteger(int64_t value) {
+    const int64_t limit = (static_cast<int64_t>(1) << 53) - 1;
+    return (value >= -limit && value <= limit);
+}
+
+// Typed cells a converter takes as they are fill the side buffer the worker
+// would otherwise fill by parsing their text. Timestamps are absolute, so
+// they skip the timezone handling of parsed dates.
+bool node_db::Conversion::assign(converter_t converter, const node_db::TypedValue& value, number_t* number) {
+    switch (value.type) {
+        case node_db::TypedValue::INT64:
+            if (converter == BIGINT) {
+                number->integer = value.value.integer;
+                return true;
+            }
+            if (converter == INT || converter == NUMBER) {
+                number->real = static_cast<double>(value.value.integer);
+                return true;
+            }
+            return false;
+        case node_db::TypedValue::DOUBLE:
+            if (converter == INT || converter == NUMBER) {
+                number->real = value.value.real;
+                return true;
+            }
+            return false;
+        case node_db::TypedValue::TIMESTAMP:
+            if (converter == TIME || converter == DATE || converter == DATETIME) {
+                number->real = static_cast<double>(value.value.micros) / 1000;
+                return true;
+            }
+            return false;
+        case node_db::TypedValue::BOOLEAN:
+            if (converter == INT || converter == NUMBER) {
+                number->real = (value.value.boolean ? 1 : 0);
+                return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+// Text for typed cells that end up converted as text after all (casting is
+// off, or the value is a BIGINT JS can't hold). Timestamps are written as
+// wall clock time in the zone of dates, the way drivers send date text.
+// text must hold 64 bytes.
+unsigned long node_db::Conversion::format(const node_db::TypedValue& value, node_db::Result::Column::type_t type, node_db::DateCodec* dates, char* text) {
+    switch (value.type) {
+        case node_db::TypedValue::INT64:
+            {
+                char digits[20];
+                char* start = digits + sizeof(digits);
+                uint64_t magnitude = (value.value.integer < 0 ? 0 - static_cast<uint64_t>(value.value.integer) : value.value.integer);
+                do {
+                    *--start = static_cast<char>('0' + magnitude % 10);
+                    magnitude /= 10;
+                } while (magnitude > 0);
+
+                unsigned long length = 0;
+                if (value.value.integer < 0) {
+                    text[length++] = '-';
+                }
+                memcpy(text + length, start, digits + sizeof(digits) - start);
+                return length + (digits + sizeof(digits) - start);
+            }
+        case node_db::TypedValue::DOUBLE:
+            return Conversion::formatNumber(value.value.real, text);
+        case node_db::TypedValue::BOOLEAN:
+            text[0] = (value.value.boolean ? '1' : '0');
+            return 1;
+        case node_db::TypedValue::TIMESTAMP:
+            {
+                int64_t micros = value.value.micros;
+                if (type == node_db::Result::Column::TIME) {
+                    uint64_t magnitude = (micros < 0 ? 0 - static_cast<uint64_t>(micros) : micros);
+                    return snprintf(text, 64, "%s%02u:%02u:%02u.%06u", micros < 0 ? "-" : "",
+                        static_cast<unsigned>(magnitude / 3600000000ULL), static_cast<unsigned>(magnitude / 60000000 % 60),
+                        static_cast<unsigned>(magnitude / 1000000 % 60), static_cast<unsigned>(magnitude % 1000000));
+                }
+
+                int64_t seconds = micros / 1000000, fraction = micros % 1000000;
+                if (fraction < 0) {
+                    fraction += 1000000;
+                    seconds--;
+                }
+
+                int64_t local = dates->toLocal(seconds);
+                int64_t days = local / 86400, daySeconds = local % 86400;
+                if (daySeconds < 0) {
+                    daySeconds += 86400;
+                    days--;
+                }
+
+                int64_t year;
+                unsigned month, day;
+                node_db::DateCodec::civilFromDays(days, &year, &month, &day);
+
+                if (type == node_db::Result::Column::DATE) {
+                    return snprintf(text, 64, "%04d-%02u-%02u", static_cast<int>(year), month, day);
+                }
+                return snprintf(text, 64, "%04d-%02u-%02u %02u:%02u:%02u.%06u", static_cast<int>(year), month, day,
+                    static_cast<unsigned>(daySeconds / 3600), static_cast<unsigned>(daySeconds / 60 % 60),
+                    static_cast<unsigned>(daySeconds % 60), static_cast<unsigned>(fraction));
+            }
+        default:
+            return 0;
+    }
+}
+
+// Shortest text that reads back as the same double: 15 digits are enough
+// for most values, no value needs more than 17. text must hold 32 bytes.
+int node_db::Conversion::formatNumber(double value, char* text) {
+    int length = snprintf(text, 32, "%.15g", value);
+    if (strtod(text, NULL) != value) {
+        length = snprintf(text, 32, "%.16g", value);
+        if (strtod(text, NULL) != value) {
+            length = snprintf(text, 32, "%.17g", value);
+        }
+    }
+    return length;
+}
@@ -0,0 +1,46 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef CONVERSION_H_
+#define CONVERSION_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./date.h"
+#include "./result.h"
+
+namespace node_db {
+// What a cell is converted to, and the conversions of typed cells that the
+// worker runs before there is any V8 value around. ConversionPlan builds
+// on it; keeping it free of V8 lets tools outside node link it.
+class Conversion {
+    public:
+        typedef enum {
+            STRING,
+            BUFFER,
+            BOOL,
+            INT,
+            NUMBER,
+            BIGINT,
+            TIME,
+            DATE,
+            DATETIME,
+            SET
+        } converter_t;
+        typedef union {
+            double real;
+            int64_t integer;
+            struct {
+                uint32_t entry;
+                bool ascii;
+            } text;
+        } number_t;
+
+        static bool isSafeInteger(int64_t value);
+        static bool assign(converter_t converter, const TypedValue& value, number_t* number);
+        static unsigned long format(const TypedValue& value, Result::Column::type_t type, DateCodec* dates, char* text);
+        static int formatNumber(double value, char* text);
+};
+}
+
+#endif  // CONVERSION_H_
@@ -0,0 +1,290 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./cursor.h"
+
+v8::Persistent<v8::FunctionTemplate> node_db::Cursor::constructorTemplate;
+
+node_db::Cursor::Cursor(): node::ObjectWrap(),
+    request(NULL), cbFetch(NULL), closing(false), closed(false), exhausting(false) {
+}
+
+node_db::Cursor::~Cursor() {
+    if (this->request != NULL && !this->request->fetching) {
+        this->release();
+    }
+
+    if (this->cbFetch != NULL) {
+        delete this->cbFetch;
+    }
+}
+
+void node_db::Cursor::Init(v8::Handle<v8::Object> target) {
+    NanScope();
+
+    v8::Local<v8::FunctionTemplate> t = v8::FunctionTemplate::New(New);
+    t->InstanceTemplate()->SetInternalFieldCount(1);
+    t->SetClassName(v8::String::NewSymbol("Cursor"));
+
+    NODE_ADD_PROTOTYPE_METHOD(t, "fetch", Fetch);
+    NODE_ADD_PROTOTYPE_METHOD(t, "close", Close);
+
+    NanAssignPersistent(v8::FunctionTemplate, constructorTemplate, t);
+}
+
+v8::Local<v8::Object> node_db::Cursor::create(node_db::Query::execute_request_t* request) {
+    v8::Local<v8::Object> instance = NanPersistentToLocal(constructorTemplate)->GetFunction()->NewInstance();
+
+    node_db::Cursor* cursor = node::ObjectWrap::Unwrap<node_db::Cursor>(instance);
+    assert(cursor);
+
+    cursor->request = request;
+
+    return instance;
+}
+
+NAN_METHOD(node_db::Cursor::New) {
+    NanScope();
+
+    node_db::Cursor* cursor = new node_db::Cursor();
+    if (cursor == NULL) {
+        THROW_EXCEPTION("Can't create cursor object")
+    }
+
+    cursor->Wrap(args.This());
+
+    NanReturnValue(args.This());
+}
+
+NAN_METHOD(node_db::Cursor::Fetch) {
+    NanScope();
+
+    ARG_CHECK_UINT32(0, rows);
+    ARG_CHECK_FUNCTION(1, callback);
+
+    node_db::Cursor* cursor = node::ObjectWrap::Unwrap<node_db::Cursor>(args.This());
+    assert(cursor);
+
+    if (cursor->closed) {
+        THROW_EXCEPTION("Can't fetch from a closed cursor")
+    }
+
+    uint32_t rows = args[0]->Uint32Value();
+    if (rows == 0) {
+        THROW_EXCEPTION("Argument \"rows\" must be greater than 0")
+    }
+
+    if (cursor->exhausting || (cursor->request != NULL && cursor->request->fetching)) {
+        THROW_EXCEPTION("A fetch is already in progress on this cursor")
+    }
+
+    if (cursor->cbFetch != NULL) {
+        delete cursor->cbFetch;
+    }
+    cursor->cbFetch = new NanCallback(args[1].As<v8::Function>());
+
+    // An exhausted cursor has nothing to fetch, but its callback still runs
+    // on a later loop iteration like that of any other fetch
+    if (cursor->request == NULL) {
+        uv_idle_t* idle = new uv_idle_t;
+        idle->data = cursor;
+        uv_idle_init(uv_default_loop(), idle);
+        uv_idle_start(idle, uvFetchExhausted);
+
+        cursor->exhausting = true;
+        cursor->Ref();
+
+        NanReturnValue(args.This());
+    }
+
+    node_db::Query::execute_request_t* request = cursor->request;
+    request->highWaterMark = rows;
+    request->fetching = true;
+
+    cursor->Ref();
+
+    if (request->connection != NULL) {
+        cursor->submit();
+    } else if (request->query->pool != NULL) {
+        request->query->pool->checkout(checkedOut, cursor);
+    } else {
+        checkedOut(request->query->connection, cursor);
+    }
+
+    NanReturnValue(args.This());
+}
+
+NAN_METHOD(node_db::Cursor::Close) {
+    NanScope();
+
+    node_db::Cursor* cursor = node::ObjectWrap::Unwrap<node_db::Cursor>(args.This());
+    assert(cursor);
+
+    cursor->closed = true;
+
+    if (cursor->request != NULL) {
+        if (cursor->request->fetching) {
+            cursor->closing = true;
+        } else {
+            cursor->release();
+        }
+    }
+
+    NanReturnValue(v8::Undefined());
+}
+
+void node_db::Cursor::checkedOut(node_db::Connection* connection, void* data) {
+    node_db::Cursor* cursor = static_cast<node_db::Cursor*>(data);
+    assert(cursor);
+
+    node_db::Query::execute_request_t* request = cursor->request;
+    request->connection = connection;
+    request->connect = (request->query->pool != NULL && request->query->pool->isOpen());
+
+    cursor->submit();
+}
+
+void node_db::Cursor::submit() {
+    this->request->query->executor(this->request->connection)->submit(uvFetch, uvFetchFinished, this);
+}
+
+void node_db::Cursor::uvFetch(void* data) {
+    node_db::Cursor* cursor = static_cast<node_db::Cursor*>(data);
+    assert(cursor);
+
+    node_db::Query::execute_request_t* request = cursor->request;
+
+    try {
+        if (request->result == NULL) {
+            node_db::Connection* connection = request->connection;
+            if (!connection->isAlive()) {
+                if (!request->connect) {
+                    throw node_db::Exception("Can't execute a query without being connected");
+                }
+                connection->open();
+            }
+
+            request->result = request->query->execute(connection);
+            request->query->project(request);
+            if (request->result == NULL || request->result->isEmpty()) {
+                request->finished = true;
+                return;
+            }
+
+            request->buffered = request->result->isBuffered();
+            request->columnCount = request->result->columnCount();
+        }
+
+        node_db::Query::fetchRows(request, request->highWaterMark);
+        node_db::Query::decodeColumns(request);
+    } catch(const node_db::Exception& exception) {
+        node_db::Query::freeRows(request);
+        request->error = new std::string(exception.what());
+    }
+}
+
+void node_db::Cursor::uvFetchFinished(void* data) {
+    NanScope();
+
+    node_db::Cursor* cursor = static_cast<node_db::Cursor*>(data);
+    assert(cursor);
+
+    node_db::Query::execute_request_t* request = cursor->request;
+    request->fetching = false;
+
+    v8::Local<v8::Value> argv[3];
+    int argc;
+
+    if (request->error != NULL) {
+        argv[0] = v8::String::New(request->error->c_str());
+        argc = 1;
+        cursor->closed = true;
+    } else {
+        v8::Local<v8::Array> rows;
+
+        if (request->rows != NULL && request->layout == node_db::Query::COLUMNAR) {
+            rows = request->query->columnar(request);
+
+            node_db::Query::freeRows(request);
+        } else if (request->rows != NULL) {
+            rows = v8::Array::New(request->rows->size());
+
+            uint32_t index = 0;
+            for (std::vector<node_db::Query::row_t*>::iterator iterator = request->rows->begin(), end = request->rows->end(); iterator != end; ++iterator, index++) {
+                rows->Set(index, request->query->row(request, *iterator));
+            }
+
+            node_db::Query::freeRows(request);
+        } else {
+            rows = v8::Array::New();
+        }
+
+        argv[0] = v8::Local<v8::Value>::New(v8::Null());
+        argv[1] = rows;
+        argc = 2;
+
+        if (request->result != NULL && !request->result->isEmpty()) {
+            argv[2] = request->query->columns(request->result);
+            argc = 3;
+        }
+    }
+
+    if (request->finished || cursor->closed || cursor->closing) {
+        cursor->release();
+    }
+
+    if (cursor->cbFetch != NULL && !cursor->cbFetch->GetFunction().IsEmpty()) {
+        v8::TryCatch tryCatch;
+        (*(cursor->cbFetch->GetFunction()))->Call(NanObjectWrapHandle(cursor), argc, argv);
+        if (tryCatch.HasCaught()) {
+            node::FatalException(tryCatch);
+        }
+    }
+
+    cursor->Unref();
+}
+
+void node_db::Cursor::uvFetchExhausted(uv_idle_t* handle, int status) {
+    NanScope();
+
+    node_db::Cursor* cursor = static_cast<node_db::Cursor*>(handle->data);
+    assert(cursor);
+
+    uv_idle_stop(handle);
+    uv_close(reinterpret_cast<uv_handle_t*>(handle), uvClosed);
+
+    cursor->exhausting = false;
+
+    if (cursor->cbFetch != NULL && !cursor->cbFetch->GetFunction().IsEmpty()) {
+        v8::Local<v8::Value> argv[2];
+        argv[0] = v8::Local<v8::Value>::New(v8::Null());
+        argv[1] = v8::Array::New();
+
+        v8::TryCatch tryCatch;
+        (*(cursor->cbFetch->GetFunction()))->Call(NanObjectWrapHandle(cursor), 2, argv);
+        if (tryCatch.HasCaught()) {
+            node::FatalException(tryCatch);
+        }
+    }
+
+    cursor->Unref();
+}
+
+void node_db::Cursor::uvClosed(uv_handle_t* handle) {
+    delete reinterpret_cast<uv_idle_t*>(handle);
+}
+
+void node_db::Cursor::release() {
+    node_db::Query::execute_request_t* request = this->request;
+    if (request == NULL) {
+        return;
+    }
+
+    node_db::ConnectionPool* pool = request->query->pool;
+    node_db::Connection* connection = request->connection;
+
+    this->request = NULL;
+    node_db::Query::freeRequest(request);
+
+    if (pool != NULL && connection != NULL) {
+        pool->checkin(connection);
+    }
+}
@@ -0,0 +1,44 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef CURSOR_H_
+#define CURSOR_H_
+
+#include <uv.h>
+#include <v8.h>
+#include <node.h>
+#include <node_object_wrap.h>
+#include <string>
+#include "./node_defs.h"
+#include "./connection.h"
+#include "./exception.h"
+#include "./query.h"
+
+namespace node_db {
+class Cursor : public node::ObjectWrap {
+    public:
+        static void Init(v8::Handle<v8::Object> target);
+        static v8::Local<v8::Object> create(Query::execute_request_t* request);
+
+    protected:
+        static v8::Persistent<v8::FunctionTemplate> constructorTemplate;
+        Query::execute_request_t* request;
+        NanCallback* cbFetch;
+        bool closing;
+        bool closed;
+        bool exhausting;
+
+        Cursor();
+        ~Cursor();
+        static NAN_METHOD(New);
+        static NAN_METHOD(Fetch);
+        static NAN_METHOD(Close);
+        static void checkedOut(Connection* connection, void* data);
+        static void uvFetch(void* data);
+        static void uvFetchFinished(void* data);
+        static void uvFetchExhausted(uv_idle_t* handle, int status);
+        static void uvClosed(uv_handle_t* handle);
+        void submit();
+        void release();
+};
+}
+
+#endif  // CURSOR_H_
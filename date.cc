@@ -0,0 +1,260 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./date.h"
+
+node_db::DateCodec::DateCodec(bool utc)
+    :utc(utc) {
+    this->last.from = 0;
+    this->last.to = 0;
+    this->last.offset = 0;
+}
+
+bool node_db::DateCodec::isUtc() const {
+    return this->utc;
+}
+
+void node_db::DateCodec::setUtc(bool utc) {
+    this->utc = utc;
+}
+
+bool node_db::DateCodec::parseDate(const char* value, unsigned long length, bool withTime, double* timeStamp) {
+    const char* current = value;
+    const char* end = value + length;
+    int64_t year, month, day, hour = 0, minute = 0, second = 0;
+    int milliseconds = 0;
+
+    if (!DateCodec::readDigits(&current, end, 4, &year) || current == end || *current++ != '-'
+        || !DateCodec::readDigits(&current, end, 2, &month) || current == end || *current++ != '-'
+        || !DateCodec::readDigits(&current, end, 2, &day)) {
+        return false;
+    }
+
+    if (withTime && current < end) {
+        if ((*current != ' ' && *current != 'T') || ++current == end
+            || !DateCodec::readDigits(&current, end, 2, &hour) || current == end || *current++ != ':'
+            || !DateCodec::readDigits(&current, end, 2, &minute) || current == end || *current++ != ':'
+            || !DateCodec::readDigits(&current, end, 2, &second)) {
+            return false;
+        }
+        milliseconds = DateCodec::readFraction(&current, end);
+    }
+
+    if (current != end || month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+        return false;
+    }
+
+    int64_t local = DateCodec::daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+
+    *timeStamp = static_cast<double>(this->utc ? local : this->toUtc(local)) * 1000 + milliseconds;
+    return true;
+}
+
+bool node_db::DateCodec::parseTime(const char* value, unsigned long length, double* timeStamp) {
+    const char* current = value;
+    const char* end = value + length;
+    int64_t hour = 0, minute, second;
+    bool negative = false;
+
+    if (current < end && *current == '-') {
+        negative = true;
+        current++;
+    }
+
+    const char* start = current;
+    for (; current < end && *current >= '0' && *current <= '9'; current++) {
+        hour = hour * 10 + (*current - '0');
+    }
+
+    if (current == start || current == end || *current++ != ':'
+        || !DateCodec::readDigits(&current, end, 2, &minute) || current == end || *current++ != ':'
+        || !DateCodec::readDigits(&current, end, 2, &second)) {
+        return false;
+    }
+
+    int milliseconds = DateCodec::readFraction(&current, end);
+    if (current != end) {
+        return false;
+    }
+
+    double result = static_cast<double>(hour * 3600 + minute * 60 + second) * 1000 + milliseconds;
+    *timeStamp = (negative ? -result : result);
+    return true;
+}
+
+std::string node_db::DateCodec::format(double timeStamp) throw(node_db::Exception&) {
+    if (timeStamp != timeStamp) {
+        throw node_db::Exception("Can't convert an invalid date");
+    }
+
+    int64_t seconds = static_cast<int64_t>(timeStamp / 1000);
+    if (seconds * 1000 > timeStamp) {
+        seconds--;
+    }
+
+    int64_t local = this->toLocal(seconds);
+    int64_t days = local / 86400, daySeconds = local % 86400;
+    if (daySeconds < 0) {
+        days--;
+        daySeconds += 86400;
+    }
+
+    int64_t year;
+    unsigned month, day;
+    DateCodec::civilFromDays(days, &year, &month, &day);
+
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%04lld-%02u-%02u %02u:%02u:%02u",
+        static_cast<long long>(year), month, day,
+        static_cast<unsigned>(daySeconds / 3600), static_cast<unsigned>((daySeconds / 60) % 60), static_cast<unsigned>(daySeconds % 60));
+
+    return std::string(buffer);
+}
+
+// days_from_civil / civil_from_days from Howard Hinnant's date algorithms
+int64_t node_db::DateCodec::daysFromCivil(int64_t year, unsigned month, unsigned day) {
+    year -= (month <= 2 ? 1 : 0);
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+    unsigned dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+}
+
+void node_db::DateCodec::civilFromDays(int64_t days, int64_t* year, unsigned* month, unsigned* day) {
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    unsigned dayOfEra = static_cast<unsigned>(days - era * 146097);
+    unsigned yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    unsigned dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    unsigned monthPosition = (5 * dayOfYear + 2) / 153;
+
+    *day = dayOfYear - (153 * monthPosition + 2) / 5 + 1;
+    *month = (monthPosition < 10 ? monthPosition + 3 : monthPosition - 9);
+    *year = static_cast<int64_t>(yearOfEra) + era * 400 + (*month <= 2 ? 1 : 0);
+}
+
+std::vector<node_db::DateCodec::span_t> node_db::DateCodec::spans;
+pthread_mutex_t node_db::DateCodec::spansLock = PTHREAD_MUTEX_INITIALIZER;
+
+// The span last used by this codec answers most lookups without the lock.
+// Spans missing from the shared table are worked out outside of it, so two
+// codecs may add the same one, which does no harm.
+int32_t node_db::DateCodec::offset(int64_t seconds) {
+    if (this->last.from <= seconds && seconds < this->last.to) {
+        return this->last.offset;
+    }
+
+    bool found = false;
+    pthread_mutex_lock(&DateCodec::spansLock);
+    for (std::vector<span_t>::size_type i = 0, limiti = DateCodec::spans.size(); i < limiti; i++) {
+        if (DateCodec::spans[i].from <= seconds && seconds < DateCodec::spans[i].to) {
+            this->last = DateCodec::spans[i];
+            found = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&DateCodec::spansLock);
+
+    if (found) {
+        return this->last.offset;
+    }
+
+    span_t span;
+    span.offset = DateCodec::probe(seconds);
+    span.from = this->boundary(seconds, -1, span.offset);
+    span.to = this->boundary(seconds, 1, span.offset);
+
+    pthread_mutex_lock(&DateCodec::spansLock);
+    if (DateCodec::spans.size() >= 64) {
+        DateCodec::spans.clear();
+    }
+    DateCodec::spans.push_back(span);
+    pthread_mutex_unlock(&DateCodec::spansLock);
+
+    this->last = span;
+    return span.offset;
+}
+
+// Seconds since the epoch as wall clock seconds in the codec's zone
+int64_t node_db::DateCodec::toLocal(int64_t seconds) {
+    return seconds + (this->utc ? 0 : this->offset(seconds));
+}
+
+int64_t node_db::DateCodec::toUtc(int64_t local) {
+    int64_t guess = local - this->offset(local);
+    return local - this->offset(guess);
+}
+
+// Walks a week at a time (up to a year) until the offset changes, then
+// bisects down to the exact second of the transition. Returns the first
+// second of the span going backwards, or one past its last going forwards
+int64_t node_db::DateCodec::boundary(int64_t seconds, int direction, int32_t offset) const {
+    const int64_t step = 7 * 86400, limit = 366 * 86400;
+    int64_t inside = seconds;
+
+    for (int64_t travelled = 0; travelled < limit; travelled += step) {
+        int64_t outside = inside + direction * step;
+        if (DateCodec::probe(outside) != offset) {
+            while ((outside - inside) * direction > 1) {
+                int64_t middle = inside + (outside - inside) / 2;
+                if (DateCodec::probe(middle) == offset) {
+                    inside = middle;
+                } else {
+                    outside = middle;
+                }
+            }
+            return (direction > 0 ? outside : inside);
+        }
+        inside = outside;
+    }
+
+    return inside;
+}
+
+int32_t node_db::DateCodec::probe(int64_t seconds) {
+    time_t rawtime = static_cast<time_t>(seconds);
+    struct tm timeinfo;
+
+    if (!localtime_r(&rawtime, &timeinfo)) {
+        return 0;
+    }
+
+    int64_t local = DateCodec::daysFromCivil(timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday) * 86400
+        + timeinfo.tm_hour * 3600 + timeinfo.tm_min * 60 + timeinfo.tm_sec;
+
+    return static_cast<int32_t>(local - seconds);
+}
+
+bool node_db::DateCodec::readDigits(const char** current, const char* end, int count, int64_t* value) {
+    if (end - *current < count) {
+        return false;
+    }
+
+    int64_t result = 0;
+    for (int i = 0; i < count; i++, (*current)++) {
+        if (**current < '0' || **current > '9') {
+            return false;
+        }
+        result = result * 10 + (**current - '0');
+    }
+
+    *value = result;
+    return true;
+}
+
+int node_db::DateCodec::readFraction(const char** current, const char* end) {
+    if (*current == end || **current != '.') {
+        return 0;
+    }
+
+    int milliseconds = 0, digits = 0;
+    for ((*current)++; *current < end && **current >= '0' && **current <= '9'; (*current)++, digits++) {
+        if (digits < 3) {
+            milliseconds = milliseconds * 10 + (**current - '0');
+        }
+    }
+    for (; digits < 3; digits++) {
+        milliseconds *= 10;
+    }
+
+    return milliseconds;
+}
@@ -0,0 +1,54 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef DATE_H_
+#define DATE_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "./exception.h"
+
+namespace node_db {
+// Converts between database date strings and JS timestamps (milliseconds
+// since the epoch) without going through sscanf, mktime or localtime for
+// every value. Local time offsets are looked up in a table of spans with a
+// constant offset, filled lazily from the system time zone database and
+// shared by every codec in the process, so only the first lookups pay for
+// working out a span. Values are read as UTC unless the codec is told
+// otherwise, as they always were. An instance is not thread safe: each
+// request owns its own.
+class DateCodec {
+    public:
+        explicit DateCodec(bool utc = true);
+        bool isUtc() const;
+        void setUtc(bool utc);
+        bool parseDate(const char* value, unsigned long length, bool withTime, double* timeStamp);
+        static bool parseTime(const char* value, unsigned long length, double* timeStamp);
+        std::string format(double timeStamp) throw(Exception&);
+        int64_t toLocal(int64_t seconds);
+        static int64_t daysFromCivil(int64_t year, unsigned month, unsigned day);
+        static void civilFromDays(int64_t days, int64_t* year, unsigned* month, unsigned* day);
+
+    protected:
+        struct span_t {
+            int64_t from;
+            int64_t to;
+            int32_t offset;
+        };
+        span_t last;
+        bool utc;
+        static std::vector<span_t> spans;
+        static pthread_mutex_t spansLock;
+
+        int32_t offset(int64_t seconds);
+        int64_t toUtc(int64_t local);
+        int64_t boundary(int64_t seconds, int direction, int32_t offset) const;
+        static int32_t probe(int64_t seconds);
+        static bool readDigits(const char** current, const char* end, int count, int64_t* value);
+        static int readFraction(const char** current, const char* end);
+};
+}
+
+#endif  // DATE_H_
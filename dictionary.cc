@@ -0,0 +1,60 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./dictionary.h"
+
+node_db::Dictionary::Dictionary(uint32_t capacity, unsigned long maxLength)
+    :capacity(capacity),
+    maxLength(maxLength),
+    enabled(true) {
+    // Open addressing table kept at most half full
+    uint32_t size = 1;
+    while (size < 2 * capacity) {
+        size <<= 1;
+    }
+
+    this->slots.resize(size, 0);
+    this->hashes.resize(size, 0);
+}
+
+// Returns the entry of the value plus one, or 0 if it isn't numbered
+uint32_t node_db::Dictionary::find(const char* value, unsigned long length) {
+    if (length > this->maxLength) {
+        return 0;
+    }
+
+    uint32_t hash = Dictionary::hash(value, length);
+    uint32_t mask = this->slots.size() - 1;
+
+    for (uint32_t slot = hash & mask; ; slot = (slot + 1) & mask) {
+        uint32_t entry = this->slots[slot];
+        if (entry == 0) {
+            // Once full, values already numbered keep being found and only
+            // new ones go without
+            if (!this->enabled || this->values.size() >= this->capacity) {
+                this->enabled = false;
+                return 0;
+            }
+
+            this->values.push_back(std::string(value, length));
+            this->slots[slot] = this->values.size();
+            this->hashes[slot] = hash;
+            return this->slots[slot];
+        }
+
+        const std::string& current = this->values[entry - 1];
+        if (this->hashes[slot] == hash && current.size() == length && memcmp(current.data(), value, length) == 0) {
+            return entry;
+        }
+    }
+}
+
+bool node_db::Dictionary::isEnabled() const {
+    return this->enabled;
+}
+
+uint32_t node_db::Dictionary::hash(const char* value, unsigned long length) {
+    uint32_t hash = 2166136261U;
+    for (unsigned long i = 0; i < length; i++) {
+        hash = (hash ^ static_cast<uint8_t>(value[i])) * 16777619U;
+    }
+    return hash;
+}
@@ -0,0 +1,34 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef DICTIONARY_H_
+#define DICTIONARY_H_
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace node_db {
+// Numbers the distinct values of a string column as rows are fetched, so
+// the main thread can build one JS string per value instead of one per
+// cell. Columns turn out not to be low cardinality once they go over the
+// capacity, and from then on no new values are numbered. Entries handed
+// out so far remain valid.
+class Dictionary {
+    public:
+        explicit Dictionary(uint32_t capacity = 256, unsigned long maxLength = 64);
+        uint32_t find(const char* value, unsigned long length);
+        bool isEnabled() const;
+
+    protected:
+        std::vector<std::string> values;
+        std::vector<uint32_t> slots;
+        std::vector<uint32_t> hashes;
+        uint32_t capacity;
+        unsigned long maxLength;
+        bool enabled;
+
+        static uint32_t hash(const char* value, unsigned long length);
+};
+}
+
+#endif  // DICTIONARY_H_
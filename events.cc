@@ -1,38 +1,50 @@
 // Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
 #include "./events.h"
 
-#if !NODE_VERSION_AT_LEAST(0, 5, 0)
+// Arguments of most events fit on the stack
+#define EMIT_STACK_ARGUMENTS 8
+
 v8::Persistent<v8::String> node_db::EventEmitter::syEmit;
-#endif
+v8::Persistent<v8::String> node_db::EventEmitter::syEvents;
 
 node_db::EventEmitter::EventEmitter() : node::ObjectWrap() {
 }
 
 void node_db::EventEmitter::Init() {
-#if !NODE_VERSION_AT_LEAST(0, 5, 0)
-    syEmit = NODE_PERSISTENT_SYMBOL("emit");
-#endif
+    if (!syEmit.IsEmpty()) {
+        return;
+    }
+
+    NanAssignPersistent(v8::String, syEmit, v8::String::NewSymbol("emit"));
+    NanAssignPersistent(v8::String, syEvents, v8::String::NewSymbol("_events"));
 }
 
 bool node_db::EventEmitter::Emit(const char* event, int argc, v8::Handle<v8::Value> argv[]) {
     NanScope();
 
+    return this->Emit(v8::String::New(event), argc, argv);
+}
+
+bool node_db::EventEmitter::Emit(v8::Handle<v8::String> event, int argc, v8::Handle<v8::Value> argv[]) {
+    NanScope();
+
     int nArgc = argc + 1;
-    v8::Handle<v8::Value>* nArgv = new v8::Handle<v8::Value>[nArgc];
-    if (nArgv == NULL) {
-        return false;
-    }
+    v8::Handle<v8::Value> stackArgv[EMIT_STACK_ARGUMENTS];
+    v8::Handle<v8::Value>* nArgv = (nArgc <= EMIT_STACK_ARGUMENTS ? stackArgv : new v8::Handle<v8::Value>[nArgc]);
 
-    nArgv[0] = v8::String::New(event);
+    nArgv[0] = event;
     for (int i=0; i < argc; i++) {
         nArgv[i + 1] = argv[i];
     }
 
 #if NODE_VERSION_AT_LEAST(0, 5, 0)
-    node::MakeCallback(NanObjectWrapHandle(this), "emit", nArgc, nArgv);
+    node::MakeCallback(NanObjectWrapHandle(this), NanPersistentToLocal(syEmit), nArgc, nArgv);
 #else
     v8::Local<v8::Value> emit_v = this->handle_->Get(syEmit);
     if (!emit_v->IsFunction()) {
+        if (nArgv != stackArgv) {
+            delete [] nArgv;
+        }
         return false;
     }
     v8::Local<v8::Function> emit = v8::Local<v8::Function>::Cast(emit_v);
@@ -41,7 +53,9 @@ bool node_db::EventEmitter::Emit(const char* event, int argc, v8::Handle<v8::Val
     emit->Call(this->handle_, nArgc, nArgv);
 #endif
 
-    delete [] nArgv;
+    if (nArgv != stackArgv) {
+        delete [] nArgv;
+    }
 
 #if !NODE_VERSION_AT_LEAST(0, 5, 0)
     if (try_catch.HasCaught()) {
@@ -51,3 +65,20 @@ bool node_db::EventEmitter::Emit(const char* event, int argc, v8::Handle<v8::Val
 
     return true;
 }
+
+// Looks at the listener registry EventEmitter keeps on the object, which is
+// much cheaper than calling listeners() from here. A stale answer only
+// costs building arguments nobody receives.
+bool node_db::EventEmitter::HasListeners(v8::Handle<v8::String> event) {
+    NanScope();
+
+    v8::Local<v8::Value> events = NanObjectWrapHandle(this)->Get(NanPersistentToLocal(syEvents));
+    if (!events->IsObject()) {
+        return false;
+    }
+
+    v8::Local<v8::Value> listeners = events->ToObject()->Get(event);
+    return !listeners->IsUndefined() && !listeners->IsNull();
+}
+
+#undef EMIT_STACK_ARGUMENTS
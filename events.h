@@ -13,12 +13,13 @@ class EventEmitter : public node::ObjectWrap {
         static void Init();
 
     protected:
-#if !NODE_VERSION_AT_LEAST(0, 5, 0)
         static v8::Persistent<v8::String> syEmit;
-#endif
+        static v8::Persistent<v8::String> syEvents;
 
         EventEmitter();
         bool Emit(const char* event, int argc,  v8::Handle<v8::Value> argv[]);
+        bool Emit(v8::Handle<v8::String> event, int argc,  v8::Handle<v8::Value> argv[]);
+        bool HasListeners(v8::Handle<v8::String> event);
 };
 }
 
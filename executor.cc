@@ -0,0 +1,172 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./executor.h"
+
+uv_async_t node_db::Executor::g_async;
+bool node_db::Executor::asyncLoaded = false;
+node_db::MpscQueue<node_db::Executor::job_t> node_db::Executor::completed;
+uint32_t node_db::Executor::pending = 0;
+uint64_t node_db::Executor::wakeups = 0;
+uint64_t node_db::Executor::completions = 0;
+
+node_db::Executor::~Executor() {
+}
+
+node_db::Executor* node_db::Executor::threadPool() {
+    static node_db::ThreadPoolExecutor executor;
+    return &executor;
+}
+
+uint64_t node_db::Executor::getWakeups() {
+    return Executor::wakeups;
+}
+
+uint64_t node_db::Executor::getCompletions() {
+    return Executor::completions;
+}
+
+node_db::Executor::job_t* node_db::Executor::createJob(work_cb work, done_cb done, void* data) {
+    if (!Executor::asyncLoaded) {
+        uv_async_init(uv_default_loop(), &g_async, uvCompleted);
+#if NODE_VERSION_AT_LEAST(0, 7, 9)
+        uv_unref((uv_handle_t *)&g_async);
+#else
+        uv_unref(uv_default_loop());
+#endif
+        Executor::asyncLoaded = true;
+    }
+
+    job_t* job = new job_t();
+    job->work = work;
+    job->done = done;
+    job->data = data;
+    job->next = NULL;
+
+    if (Executor::pending++ == 0) {
+#if NODE_VERSION_AT_LEAST(0, 7, 9)
+        uv_ref((uv_handle_t *)&g_async);
+#else
+        uv_ref(uv_default_loop());
+#endif
+    }
+
+    return job;
+}
+
+void node_db::Executor::complete(job_t* job) {
+    if (Executor::completed.push(job)) {
+        uv_async_send(&g_async);
+    }
+}
+
+void node_db::Executor::uvCompleted(uv_async_t* handle, int status) {
+    job_t* job = Executor::completed.drain();
+    if (job == NULL) {
+        return;
+    }
+
+    Executor::wakeups++;
+
+    while (job != NULL) {
+        job_t* next = job->next;
+
+        job->done(job->data);
+        delete job;
+
+        Executor::completions++;
+        if (--Executor::pending == 0) {
+#if NODE_VERSION_AT_LEAST(0, 7, 9)
+            uv_unref((uv_handle_t *)&g_async);
+#else
+            uv_unref(uv_default_loop());
+#endif
+        }
+
+        job = next;
+    }
+}
+
+void node_db::ThreadPoolExecutor::submit(work_cb work, done_cb done, void* data) {
+    uv_work_t* req = new uv_work_t();
+    req->data = Executor::createJob(work, done, data);
+    uv_queue_work(uv_default_loop(), req, uvWork, (uv_after_work_cb)uvWorkFinished);
+}
+
+void node_db::ThreadPoolExecutor::uvWork(uv_work_t* uvRequest) {
+    job_t* job = static_cast<job_t*>(uvRequest->data);
+    assert(job);
+
+    job->work(job->data);
+
+    Executor::complete(job);
+}
+
+void node_db::ThreadPoolExecutor::uvWorkFinished(uv_work_t* uvRequest, int status) {
+    delete uvRequest;
+}
+
+node_db::WorkerThread::WorkerThread() throw(node_db::Exception&) : stopping(false) {
+    pthread_mutex_init(&(this->sleepLock), NULL);
+    pthread_cond_init(&(this->wakeup), NULL);
+
+    if (pthread_create(&(this->thread), NULL, run, this) != 0) {
+        pthread_cond_destroy(&(this->wakeup));
+        pthread_mutex_destroy(&(this->sleepLock));
+        throw node_db::Exception("Could not create worker thread");
+    }
+}
+
+node_db::WorkerThread::~WorkerThread() {
+    pthread_mutex_lock(&(this->sleepLock));
+    this->stopping = true;
+    pthread_cond_signal(&(this->wakeup));
+    pthread_mutex_unlock(&(this->sleepLock));
+
+    pthread_join(this->thread, NULL);
+
+    pthread_cond_destroy(&(this->wakeup));
+    pthread_mutex_destroy(&(this->sleepLock));
+}
+
+void node_db::WorkerThread::submit(work_cb work, done_cb done, void* data) {
+    job_t* job = Executor::createJob(work, done, data);
+
+    if (this->jobs.push(job)) {
+        pthread_mutex_lock(&(this->sleepLock));
+        pthread_cond_signal(&(this->wakeup));
+        pthread_mutex_unlock(&(this->sleepLock));
+    }
+}
+
+void* node_db::WorkerThread::run(void* data) {
+    WorkerThread* worker = static_cast<WorkerThread*>(data);
+    assert(worker);
+
+    while (true) {
+        job_t* job = worker->jobs.drain();
+
+        if (job == NULL) {
+            pthread_mutex_lock(&(worker->sleepLock));
+            while (worker->jobs.isEmpty() && !worker->stopping) {
+                pthread_cond_wait(&(worker->wakeup), &(worker->sleepLock));
+            }
+            bool stop = (worker->stopping && worker->jobs.isEmpty());
+            pthread_mutex_unlock(&(worker->sleepLock));
+
+            if (stop) {
+                break;
+            }
+            continue;
+        }
+
+        while (job != NULL) {
+            job_t* next = job->next;
+
+            job->work(job->data);
+            Executor::complete(job);
+
+            job = next;
+        }
+    }
+
+    return NULL;
+}
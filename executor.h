@@ -0,0 +1,75 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef EXECUTOR_H_
+#define EXECUTOR_H_
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <uv.h>
+#include <node_version.h>
+#include "./exception.h"
+#include "./queue.h"
+
+namespace node_db {
+// Jobs run on a worker and are then pushed onto one process wide completion
+// queue. A single uv_async_t wakes the loop, which runs the done callbacks
+// of every job completed since the previous wakeup in one batch.
+class Executor {
+    public:
+        typedef void (*work_cb)(void* data);
+        typedef void (*done_cb)(void* data);
+
+        virtual ~Executor();
+        virtual void submit(work_cb work, done_cb done, void* data) = 0;
+        static Executor* threadPool();
+        static uint64_t getWakeups();
+        static uint64_t getCompletions();
+
+    protected:
+        struct job_t {
+            work_cb work;
+            done_cb done;
+            void* data;
+            job_t* next;
+        };
+        static uv_async_t g_async;
+        static bool asyncLoaded;
+        static MpscQueue<job_t> completed;
+        static uint32_t pending;
+        static uint64_t wakeups;
+        static uint64_t completions;
+
+        static job_t* createJob(work_cb work, done_cb done, void* data);
+        static void complete(job_t* job);
+        static void uvCompleted(uv_async_t* handle, int status);
+};
+
+class ThreadPoolExecutor : public Executor {
+    public:
+        void submit(work_cb work, done_cb done, void* data);
+
+    protected:
+        static void uvWork(uv_work_t* uvRequest);
+        static void uvWorkFinished(uv_work_t* uvRequest, int status);
+};
+
+// Long lived thread that runs the jobs of a single connection, so database
+// latency doesn't compete with other users of the libuv threadpool.
+class WorkerThread : public Executor {
+    public:
+        WorkerThread() throw(Exception&);
+        ~WorkerThread();
+        void submit(work_cb work, done_cb done, void* data);
+
+    protected:
+        pthread_t thread;
+        pthread_mutex_t sleepLock;
+        pthread_cond_t wakeup;
+        MpscQueue<job_t> jobs;
+        bool stopping;
+
+        static void* run(void* data);
+};
+}
+
+#endif  // EXECUTOR_H_
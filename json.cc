@@ -0,0 +1,352 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./json.h"
+
+node_db::JsonWriter::JsonWriter(node_db::Result* result, const std::vector<node_db::ConversionPlan::converter_t>& converters, bool arrays, bool lines)
+    :converters(converters),
+    arrays(arrays),
+    lines(lines),
+    first(true),
+    data(NULL),
+    size(0),
+    capacity(0) {
+    // Object keys are escaped once per result, colon included
+    if (!arrays) {
+        JsonWriter writer(result, std::vector<node_db::ConversionPlan::converter_t>(), true, true);
+        std::vector<size_t> ends;
+
+        for (uint16_t i = 0, limiti = converters.size(); i < limiti; i++) {
+            std::string name = result->column(i)->getName();
+            writer.string(name.c_str(), name.length());
+            writer.append(':');
+            ends.push_back(writer.size);
+        }
+
+        size_t length, start = 0;
+        char* text = writer.release(&length);
+        for (std::vector<size_t>::iterator end = ends.begin(), limit = ends.end(); end != limit; ++end) {
+            this->keys.push_back(std::string(text + start, *end - start));
+            start = *end;
+        }
+        free(text);
+    }
+}
+
+node_db::JsonWriter::~JsonWriter() {
+    free(this->data);
+}
+
+void node_db::JsonWriter::begin(bool first) throw(node_db::Exception&) {
+    this->first = first;
+    if (first && !this->lines) {
+        this->append('[');
+    }
+}
+
+void node_db::JsonWriter::row(char** columns, unsigned long* columnLengths, const node_db::ConversionPlan::number_t* numbers) throw(node_db::Exception&) {
+    if (!this->lines && !this->first) {
+        this->append(',');
+    }
+    this->first = false;
+
+    this->append(this->arrays ? '[' : '{');
+
+    for (uint16_t i = 0, limiti = this->converters.size(); i < limiti; i++) {
+        if (i > 0) {
+            this->append(',');
+        }
+        if (!this->arrays) {
+            this->append(this->keys[i].data(), this->keys[i].length());
+        }
+        this->cell(this->converters[i], columns[i], columnLengths[i], numbers != NULL ? &numbers[i] : NULL);
+    }
+
+    this->append(this->arrays ? ']' : '}');
+
+    if (this->lines) {
+        this->append('\n');
+    }
+}
+
+void node_db::JsonWriter::end(bool last) throw(node_db::Exception&) {
+    if (last && !this->lines) {
+        this->append(']');
+    }
+}
+
+char* node_db::JsonWriter::release(size_t* length) {
+    char* data = this->data;
+    *length = this->size;
+
+    this->data = NULL;
+    this->size = 0;
+    this->capacity = 0;
+
+    return data;
+}
+
+void node_db::JsonWriter::cell(node_db::ConversionPlan::converter_t converter, const char* value, unsigned long length, const node_db::ConversionPlan::number_t* number) throw(node_db::Exception&) {
+    if (value == NULL) {
+        this->append("null", 4);
+        return;
+    }
+
+    if (number == NULL && node_db::ConversionPlan::isDecoded(converter) && converter != node_db::ConversionPlan::SET) {
+        this->string(value, length);
+        return;
+    }
+
+    switch (converter) {
+        case node_db::ConversionPlan::BOOL:
+            if (length == 0 || value[0] != '0') {
+                this->append("true", 4);
+            } else {
+                this->append("false", 5);
+            }
+            break;
+        case node_db::ConversionPlan::INT:
+        case node_db::ConversionPlan::NUMBER:
+            // Database text is kept as is whenever it already is a JSON
+            // number, and an integer one for INT cells, which are truncated
+            {
+                int64_t integer;
+                if (JsonWriter::isNumber(value, length)
+                    && (converter == node_db::ConversionPlan::NUMBER || node_db::ConversionPlan::parseInteger(value, length, &integer))) {
+                    this->append(value, length);
+                } else {
+                    this->number(number->real);
+                }
+            }
+            break;
+        case node_db::ConversionPlan::BIGINT:
+            // Typed cells may have no text when they are safe integers
+            if (!node_db::ConversionPlan::isSafeInteger(number->integer)) {
+                this->string(value, length);
+            } else if (JsonWriter::isNumber(value, length)) {
+                this->append(value, length);
+            } else {
+                this->number(static_cast<double>(number->integer));
+            }
+            break;
+        case node_db::ConversionPlan::TIME:
+        case node_db::ConversionPlan::DATE:
+        case node_db::ConversionPlan::DATETIME:
+            if (number->real != number->real) {
+                this->string(value, length);
+            } else {
+                this->date(number->real);
+            }
+            break;
+        case node_db::ConversionPlan::SET:
+            this->set(value, length);
+            break;
+        case node_db::ConversionPlan::BUFFER:
+            this->buffer(value, length);
+            break;
+        default:
+            this->string(value, length);
+            break;
+    }
+}
+
+void node_db::JsonWriter::string(const char* value, unsigned long length) throw(node_db::Exception&) {
+    static const char hex[] = "0123456789abcdef";
+    const char* current = value;
+    const char* end = value + length;
+
+    this->reserve(length + 2);
+    this->append('"');
+
+    while (current < end) {
+        // Copy runs that need no escaping in one go
+        const char* run = current;
+        while (current < end && static_cast<unsigned char>(*current) >= 0x20 && *current != '"' && *current != '\\') {
+            current++;
+        }
+        if (current > run) {
+            this->append(run, current - run);
+        }
+        if (current == end) {
+            break;
+        }
+
+        char escaped[6] = { '\\', 0, 0, 0, 0, 0 };
+        size_t escapedLength = 2;
+        switch (*current) {
+            case '"': escaped[1] = '"'; break;
+            case '\\': escaped[1] = '\\'; break;
+            case '\b': escaped[1] = 'b'; break;
+            case '\f': escaped[1] = 'f'; break;
+            case '\n': escaped[1] = 'n'; break;
+            case '\r': escaped[1] = 'r'; break;
+            case '\t': escaped[1] = 't'; break;
+            default:
+                escaped[1] = 'u';
+                escaped[2] = '0';
+                escaped[3] = '0';
+                escaped[4] = hex[(*current >> 4) & 0xf];
+                escaped[5] = hex[*current & 0xf];
+                escapedLength = 6;
+                break;
+        }
+        this->append(escaped, escapedLength);
+        current++;
+    }
+
+    this->append('"');
+}
+
+void node_db::JsonWriter::number(double value) throw(node_db::Exception&) {
+    if (value != value || value == HUGE_VAL || value == -HUGE_VAL) {
+        this->append("null", 4);
+        return;
+    }
+
+    char buffer[32];
+    int length = node_db::ConversionPlan::formatNumber(value, buffer);
+    this->append(buffer, length);
+}
+
+// Same text as Date.prototype.toJSON
+void node_db::JsonWriter::date(double timeStamp) throw(node_db::Exception&) {
+    int64_t milliseconds = static_cast<int64_t>(timeStamp);
+    int64_t days = milliseconds / 86400000;
+    int64_t remainder = milliseconds % 86400000;
+    if (remainder < 0) {
+        remainder += 86400000;
+        days--;
+    }
+
+    int64_t year;
+    unsigned month, day;
+    node_db::DateCodec::civilFromDays(days, &year, &month, &day);
+
+    char buffer[40];
+    int length;
+    if (year >= 0 && year <= 9999) {
+        length = snprintf(buffer, sizeof(buffer), "\"%04d-%02u-%02uT%02d:%02d:%02d.%03dZ\"",
+            static_cast<int>(year), month, day,
+            static_cast<int>(remainder / 3600000), static_cast<int>(remainder / 60000 % 60),
+            static_cast<int>(remainder / 1000 % 60), static_cast<int>(remainder % 1000));
+    } else {
+        length = snprintf(buffer, sizeof(buffer), "\"%c%06d-%02u-%02uT%02d:%02d:%02d.%03dZ\"",
+            year < 0 ? '-' : '+', static_cast<int>(year < 0 ? -year : year), month, day,
+            static_cast<int>(remainder / 3600000), static_cast<int>(remainder / 60000 % 60),
+            static_cast<int>(remainder / 1000 % 60), static_cast<int>(remainder % 1000));
+    }
+    this->append(buffer, length);
+}
+
+void node_db::JsonWriter::set(const char* value, unsigned long length) throw(node_db::Exception&) {
+    const char* current = value;
+    const char* end = value + length;
+    bool first = true;
+
+    this->append('[');
+    while (current < end) {
+        const char* separator = static_cast<const char*>(memchr(current, ',', end - current));
+        if (separator == NULL) {
+            separator = end;
+        }
+
+        if (separator > current) {
+            if (!first) {
+                this->append(',');
+            }
+            this->string(current, separator - current);
+            first = false;
+        }
+        current = separator + 1;
+    }
+    this->append(']');
+}
+
+// Same text as Buffer.prototype.toJSON
+void node_db::JsonWriter::buffer(const char* value, unsigned long length) throw(node_db::Exception&) {
+    this->reserve(length * 4 + 32);
+    this->append("{\"type\":\"Buffer\",\"data\":[", 25);
+    for (unsigned long i = 0; i < length; i++) {
+        char digits[4];
+        int digitsLength = snprintf(digits, sizeof(digits), "%u", static_cast<unsigned>(static_cast<unsigned char>(value[i])));
+        if (i > 0) {
+            this->append(',');
+        }
+        this->append(digits, digitsLength);
+    }
+    this->append("]}", 2);
+}
+
+void node_db::JsonWriter::append(const char* value, size_t length) throw(node_db::Exception&) {
+    this->reserve(length);
+    memcpy(this->data + this->size, value, length);
+    this->size += length;
+}
+
+void node_db::JsonWriter::append(char value) throw(node_db::Exception&) {
+    this->reserve(1);
+    this->data[this->size++] = value;
+}
+
+void node_db::JsonWriter::reserve(size_t length) throw(node_db::Exception&) {
+    if (this->size + length <= this->capacity) {
+        return;
+    }
+
+    size_t capacity = (this->capacity > 0 ? this->capacity * 2 : 64 * 1024);
+    while (capacity < this->size + length) {
+        capacity *= 2;
+    }
+
+    char* data = static_cast<char*>(realloc(this->data, capacity));
+    if (data == NULL) {
+        throw node_db::Exception("Could not allocate memory for JSON output");
+    }
+
+    this->data = data;
+    this->capacity = capacity;
+}
+
+// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+bool node_db::JsonWriter::isNumber(const char* value, unsigned long length) {
+    const char* current = value;
+    const char* end = value + length;
+
+    if (current < end && *current == '-') {
+        current++;
+    }
+    if (current == end || *current < '0' || *current > '9') {
+        return false;
+    }
+    if (*current == '0') {
+        current++;
+    } else {
+        while (current < end && *current >= '0' && *current <= '9') {
+            current++;
+        }
+    }
+
+    if (current < end && *current == '.') {
+        const char* digits = ++current;
+        while (current < end && *current >= '0' && *current <= '9') {
+            current++;
+        }
+        if (current == digits) {
+            return false;
+        }
+    }
+
+    if (current < end && (*current == 'e' || *current == 'E')) {
+        current++;
+        if (current < end && (*current == '+' || *current == '-')) {
+            current++;
+        }
+        const char* digits = current;
+        while (current < end && *current >= '0' && *current <= '9') {
+            current++;
+        }
+        if (current == digits) {
+            return false;
+        }
+    }
+
+    return current == end;
+}
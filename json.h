@@ -0,0 +1,54 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef JSON_H_
+#define JSON_H_
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "./date.h"
+#include "./exception.h"
+#include "./plan.h"
+#include "./result.h"
+
+namespace node_db {
+// Serializes fetched rows straight to JSON text on the worker thread, with
+// the same values JSON.stringify would produce for converted rows. Either
+// one document per result ("[...]", possibly written over several batches
+// that concatenate into it) or one line per row (NDJSON).
+class JsonWriter {
+    public:
+        JsonWriter(Result* result, const std::vector<ConversionPlan::converter_t>& converters, bool arrays, bool lines);
+        ~JsonWriter();
+        void begin(bool first) throw(Exception&);
+        void row(char** columns, unsigned long* columnLengths, const ConversionPlan::number_t* numbers) throw(Exception&);
+        void end(bool last) throw(Exception&);
+        char* release(size_t* length);
+        static bool isNumber(const char* value, unsigned long length);
+
+    protected:
+        std::vector<ConversionPlan::converter_t> converters;
+        std::vector<std::string> keys;
+        bool arrays;
+        bool lines;
+        bool first;
+        char* data;
+        size_t size;
+        size_t capacity;
+
+        void cell(ConversionPlan::converter_t converter, const char* value, unsigned long length, const ConversionPlan::number_t* number) throw(Exception&);
+        void string(const char* value, unsigned long length) throw(Exception&);
+        void number(double value) throw(Exception&);
+        void date(double timeStamp) throw(Exception&);
+        void set(const char* value, unsigned long length) throw(Exception&);
+        void buffer(const char* value, unsigned long length) throw(Exception&);
+        void append(const char* value, size_t length) throw(Exception&);
+        void append(char value) throw(Exception&);
+        void reserve(size_t length) throw(Exception&);
+};
+}
+
+#endif  // JSON_H_
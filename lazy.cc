@@ -0,0 +1,160 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./lazy.h"
+
+#if (NODE_MODULE_VERSION > 0x000B)
+# define NOT_INTERCEPTED(type) return
+#else
+# define NOT_INTERCEPTED(type) return v8::Handle<type>()
+#endif
+
+v8::Persistent<v8::FunctionTemplate> node_db::LazyRow::constructorTemplate;
+
+node_db::LazyRow::LazyRow(): node::ObjectWrap(),
+    plan(NULL), columns(NULL), columnLengths(NULL), numbers(NULL) {
+}
+
+node_db::LazyRow::~LazyRow() {
+    for (std::vector<void*>::iterator iterator = this->chunks.begin(), end = this->chunks.end(); iterator != end; ++iterator) {
+        node_db::Arena::release(*iterator);
+    }
+
+    if (this->plan != NULL) {
+        this->plan->release();
+    }
+}
+
+void node_db::LazyRow::Init(v8::Handle<v8::Object> target) {
+    NanScope();
+
+    v8::Local<v8::FunctionTemplate> t = v8::FunctionTemplate::New(New);
+    t->SetClassName(v8::String::NewSymbol("LazyRow"));
+
+    // The second internal field holds the array of already converted values
+    v8::Local<v8::ObjectTemplate> instanceTemplate = t->InstanceTemplate();
+    instanceTemplate->SetInternalFieldCount(2);
+    instanceTemplate->SetNamedPropertyHandler(GetColumn, SetColumn, QueryColumn, 0, EnumerateColumns);
+
+    NanAssignPersistent(v8::FunctionTemplate, constructorTemplate, t);
+}
+
+v8::Local<v8::Object> node_db::LazyRow::create(node_db::ConversionPlan* plan, char** columns, unsigned long* columnLengths, node_db::ConversionPlan::number_t* numbers, node_db::Arena* arena) {
+    v8::Local<v8::Object> instance = NanPersistentToLocal(constructorTemplate)->GetFunction()->NewInstance();
+
+    node_db::LazyRow* row = node::ObjectWrap::Unwrap<node_db::LazyRow>(instance);
+    assert(row);
+
+    uint16_t columnCount = plan->columnCount();
+
+    plan->retain();
+    row->plan = plan;
+    row->columns = columns;
+    row->columnLengths = columnLengths;
+    row->numbers = numbers;
+
+    row->retain(arena, columns);
+    row->retain(arena, columnLengths);
+    if (numbers != NULL) {
+        row->retain(arena, numbers);
+    }
+    for (uint16_t i = 0; i < columnCount; i++) {
+        if (columns[i] != NULL) {
+            row->retain(arena, columns[i]);
+        }
+    }
+
+    instance->SetInternalField(1, v8::Array::New(columnCount));
+
+    return instance;
+}
+
+NAN_METHOD(node_db::LazyRow::New) {
+    NanScope();
+
+    node_db::LazyRow* row = new node_db::LazyRow();
+    if (row == NULL) {
+        THROW_EXCEPTION("Can't create row object")
+    }
+
+    row->Wrap(args.This());
+
+    NanReturnValue(args.This());
+}
+
+NAN_PROPERTY_GETTER(node_db::LazyRow::GetColumn) {
+    NanScope();
+
+    node_db::LazyRow* row = node::ObjectWrap::Unwrap<node_db::LazyRow>(args.Holder());
+    int column = (row->plan != NULL ? row->plan->column(property) : -1);
+    if (column < 0) {
+        NOT_INTERCEPTED(v8::Value);
+    }
+
+    NanReturnValue(row->value(args.Holder(), column));
+}
+
+NAN_PROPERTY_SETTER(node_db::LazyRow::SetColumn) {
+    NanScope();
+
+    node_db::LazyRow* row = node::ObjectWrap::Unwrap<node_db::LazyRow>(args.Holder());
+    int column = (row->plan != NULL ? row->plan->column(property) : -1);
+    if (column < 0) {
+        NOT_INTERCEPTED(v8::Value);
+    }
+
+    args.Holder()->GetInternalField(1).As<v8::Array>()->Set(column, value);
+
+    NanReturnValue(value);
+}
+
+NAN_PROPERTY_QUERY(node_db::LazyRow::QueryColumn) {
+    NanScope();
+
+    node_db::LazyRow* row = node::ObjectWrap::Unwrap<node_db::LazyRow>(args.Holder());
+    if (row->plan == NULL || row->plan->column(property) < 0) {
+        NOT_INTERCEPTED(v8::Integer);
+    }
+
+    NanReturnValue(v8::Integer::New(v8::None));
+}
+
+NAN_PROPERTY_ENUMERATOR(node_db::LazyRow::EnumerateColumns) {
+    NanScope();
+
+    node_db::LazyRow* row = node::ObjectWrap::Unwrap<node_db::LazyRow>(args.Holder());
+    uint16_t columnCount = (row->plan != NULL ? row->plan->columnCount() : 0);
+    v8::Local<v8::Array> names = v8::Array::New(columnCount);
+
+    for (uint16_t i = 0; i < columnCount; i++) {
+        names->Set(i, row->plan->name(i));
+    }
+
+    NanReturnValue(names);
+}
+
+// Holds on to the arena chunk a piece of the row lives in, once per chunk
+void node_db::LazyRow::retain(node_db::Arena* arena, const void* pointer) {
+    void* chunk = arena->retain(pointer);
+    if (chunk == NULL) {
+        return;
+    }
+
+    if (std::find(this->chunks.begin(), this->chunks.end(), chunk) != this->chunks.end()) {
+        node_db::Arena::release(chunk);
+    } else {
+        this->chunks.push_back(chunk);
+    }
+}
+
+v8::Local<v8::Value> node_db::LazyRow::value(v8::Local<v8::Object> object, uint16_t column) {
+    v8::Local<v8::Array> cache = object->GetInternalField(1).As<v8::Array>();
+    v8::Local<v8::Value> value = cache->Get(column);
+
+    if (value->IsUndefined()) {
+        value = this->plan->cell(column, this->columns[column], this->columnLengths[column], this->numbers != NULL ? &(this->numbers[column]) : NULL, NULL);
+        cache->Set(column, value);
+    }
+
+    return value;
+}
+
+#undef NOT_INTERCEPTED
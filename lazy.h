@@ -0,0 +1,44 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef LAZY_H_
+#define LAZY_H_
+
+#include <v8.h>
+#include <node.h>
+#include <node_object_wrap.h>
+#include <algorithm>
+#include <vector>
+#include "./node_defs.h"
+#include "./arena.h"
+#include "./plan.h"
+#include "nan.h"
+
+namespace node_db {
+// Row whose columns are only converted when read. It keeps the arena chunks
+// holding its cells and the plan of its result alive, and caches each value
+// after the first access so a column is never converted twice.
+class LazyRow : public node::ObjectWrap {
+    public:
+        static void Init(v8::Handle<v8::Object> target);
+        static v8::Local<v8::Object> create(ConversionPlan* plan, char** columns, unsigned long* columnLengths, ConversionPlan::number_t* numbers, Arena* arena);
+
+    protected:
+        static v8::Persistent<v8::FunctionTemplate> constructorTemplate;
+        ConversionPlan* plan;
+        char** columns;
+        unsigned long* columnLengths;
+        ConversionPlan::number_t* numbers;
+        std::vector<void*> chunks;
+
+        LazyRow();
+        ~LazyRow();
+        static NAN_METHOD(New);
+        static NAN_PROPERTY_GETTER(GetColumn);
+        static NAN_PROPERTY_SETTER(SetColumn);
+        static NAN_PROPERTY_QUERY(QueryColumn);
+        static NAN_PROPERTY_ENUMERATOR(EnumerateColumns);
+        void retain(Arena* arena, const void* pointer);
+        v8::Local<v8::Value> value(v8::Local<v8::Object> object, uint16_t column);
+};
+}
+
+#endif  // LAZY_H_
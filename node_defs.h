@@ -154,4 +154,10 @@ do {                                                                      \
         THROW_EXCEPTION("Option \"" #KEY "\" must be a valid function") \
     }
 
+#define ARG_CHECK_OBJECT_ATTR_OPTIONAL_ARRAY(VAR, KEY) \
+    v8::Local<v8::String> KEY##_##key = v8::String::New("" #KEY ""); \
+    if (VAR->Has(KEY##_##key) && !VAR->Get(KEY##_##key)->IsArray()) { \
+        THROW_EXCEPTION("Option \"" #KEY "\" must be a valid array") \
+    }
+
 #endif  // NODE_DEFS_H_
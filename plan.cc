@@ -0,0 +1,530 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./plan.h"
+
+node_db::ConversionPlan::ConversionPlan(node_db::Result* result, bool cast, bool bufferText, bool arrays, bigint_t bigint, bool utc)
+    :dates(new node_db::DateCodec(utc)),
+    arrays(arrays),
+    refs(1) {
+    uint16_t columnCount = result->columnCount();
+    v8::Local<v8::ObjectTemplate> objectTemplate = v8::ObjectTemplate::New();
+
+    this->converters.reserve(columnCount);
+    this->names.resize(columnCount);
+    this->members.resize(columnCount);
+    this->entries.resize(columnCount);
+
+    for (uint16_t i = 0; i < columnCount; i++) {
+        node_db::Result::Column* column = result->column(i);
+
+        this->converters.push_back(ConversionPlan::converter(column, cast, bufferText, bigint));
+
+        v8::Local<v8::String> name = v8::String::NewSymbol(column->getName().c_str());
+        NanAssignPersistent(v8::String, this->names[i], name);
+
+        if (!arrays) {
+            objectTemplate->Set(name, v8::Null());
+        }
+    }
+
+    NanAssignPersistent(v8::ObjectTemplate, this->objectTemplate, objectTemplate);
+}
+
+node_db::ConversionPlan::~ConversionPlan() {
+    for (std::vector< v8::Persistent<v8::String> >::iterator iterator = this->names.begin(), end = this->names.end(); iterator != end; ++iterator) {
+        NanDispose(*iterator);
+    }
+
+    NanDispose(this->objectTemplate);
+
+    for (std::vector< std::vector<member_t> >::iterator column = this->members.begin(), end = this->members.end(); column != end; ++column) {
+        for (std::vector<member_t>::iterator member = column->begin(), limit = column->end(); member != limit; ++member) {
+            NanDispose(member->string);
+        }
+    }
+
+    for (std::vector< std::vector< v8::Persistent<v8::String> > >::iterator column = this->entries.begin(), end = this->entries.end(); column != end; ++column) {
+        for (std::vector< v8::Persistent<v8::String> >::iterator entry = column->begin(), limit = column->end(); entry != limit; ++entry) {
+            if (!entry->IsEmpty()) {
+                NanDispose(*entry);
+            }
+        }
+    }
+
+    delete this->dates;
+}
+
+void node_db::ConversionPlan::retain() {
+    this->refs++;
+}
+
+void node_db::ConversionPlan::release() {
+    if (--this->refs == 0) {
+        delete this;
+    }
+}
+
+node_db::ConversionPlan::converter_t node_db::ConversionPlan::converter(node_db::Result::Column* column, bool cast, bool bufferText, bigint_t bigint) {
+    if (!cast) {
+        return STRING;
+    }
+
+    switch (column->getType()) {
+        case node_db::Result::Column::BOOL:
+            return BOOL;
+        case node_db::Result::Column::INT:
+            return INT;
+        case node_db::Result::Column::NUMBER:
+            return NUMBER;
+        case node_db::Result::Column::BIGINT:
+            if (bigint == BIGINT_NUMBER) {
+                return NUMBER;
+            }
+            return (bigint == BIGINT_EXACT ? BIGINT : STRING);
+        case node_db::Result::Column::TIME:
+            return TIME;
+        case node_db::Result::Column::DATE:
+            return DATE;
+        case node_db::Result::Column::DATETIME:
+            return DATETIME;
+        case node_db::Result::Column::SET:
+            return SET;
+        case node_db::Result::Column::TEXT:
+            return (bufferText || column->isBinary() ? BUFFER : STRING);
+        default:
+            return STRING;
+    }
+}
+
+uint16_t node_db::ConversionPlan::columnCount() const {
+    return this->converters.size();
+}
+
+int node_db::ConversionPlan::column(v8::Local<v8::String> name) const {
+    for (uint16_t i = 0, limiti = this->names.size(); i < limiti; i++) {
+        if (name->StrictEquals(NanPersistentToLocal(this->names[i]))) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+v8::Local<v8::String> node_db::ConversionPlan::name(uint16_t column) const {
+    return NanPersistentToLocal(this->names[column]);
+}
+
+v8::Local<v8::Object> node_db::ConversionPlan::row(char** columns, unsigned long* columnLengths, const number_t* numbers, node_db::Arena* arena) const {
+    uint16_t columnCount = this->converters.size();
+
+    if (this->arrays) {
+        v8::Local<v8::Array> row = v8::Array::New(columnCount);
+
+        for (uint16_t i = 0; i < columnCount; i++) {
+            row->Set(i, this->cell(i, columns[i], columnLengths[i], numbers != NULL ? &numbers[i] : NULL, arena));
+        }
+
+        return row;
+    }
+
+    // Every row starts from the same template, so all rows of a result
+    // share one hidden class and the sets below only overwrite fields
+    v8::Local<v8::Object> row = NanPersistentToLocal(this->objectTemplate)->NewInstance();
+
+    for (uint16_t i = 0; i < columnCount; i++) {
+        row->Set(NanPersistentToLocal(this->names[i]), this->cell(i, columns[i], columnLengths[i], numbers != NULL ? &numbers[i] : NULL, arena));
+    }
+
+    return row;
+}
+
+v8::Local<v8::Value> node_db::ConversionPlan::cell(uint16_t column, const char* value, unsigned long length, const number_t* number, node_db::Arena* arena) const {
+    if (value == NULL) {
+        return v8::Local<v8::Value>::New(v8::Null());
+    }
+
+    converter_t converter = this->converters[column];
+    number_t decoded;
+
+    // Numbers and dates normally come already decoded from the worker thread
+    if (number == NULL && ConversionPlan::isDecoded(converter)) {
+        ConversionPlan::decode(converter, value, length, &decoded, this->dates);
+        number = &decoded;
+    }
+
+    switch (converter) {
+        case BOOL:
+            return v8::Local<v8::Value>::New(length == 0 || value[0] != '0' ? v8::True() : v8::False());
+        case INT:
+        case NUMBER:
+            return v8::Number::New(number->real);
+        case BIGINT:
+            if (ConversionPlan::isSafeInteger(number->integer)) {
+                return v8::Number::New(static_cast<double>(number->integer));
+            }
+            return v8::String::New(value, length);
+        case TIME:
+        case DATE:
+        case DATETIME:
+            if (number->real != number->real) {
+                return v8::String::New(value, length);
+            }
+            return v8::Date::New(number->real);
+        case SET:
+            return this->set(column, value, length, number->integer);
+        case BUFFER:
+            return this->buffer(value, length, arena);
+        default:
+            if (number != NULL && number->text.entry > 0) {
+                return this->entry(column, number->text.entry - 1, value, length);
+            }
+            if (number != NULL && number->text.ascii) {
+                return this->string(value, length, arena);
+            }
+            return v8::String::New(value, length);
+    }
+}
+
+v8::Local<v8::Value> node_db::ConversionPlan::buffer(const char* value, unsigned long length, node_db::Arena* arena) const {
+    // Cells copied into the arena are exposed in place, keeping their chunk
+    // alive until the Buffer is collected, unless they are too small a part
+    // of it. Anything else is copied once
+    size_t pinned;
+    void* chunk = (arena != NULL ? arena->pin(value, length, &pinned) : NULL);
+    if (chunk != NULL) {
+        ConversionPlan::adjustExternalMemory(static_cast<int64_t>(pinned));
+        return NanNewBufferHandle(const_cast<char*>(value), length, ConversionPlan::releaseBuffer, chunk);
+    }
+
+    return NanNewBufferHandle(const_cast<char*>(value), static_cast<uint32_t>(length));
+}
+
+void node_db::ConversionPlan::releaseBuffer(char* data, void* hint) {
+    ConversionPlan::adjustExternalMemory(-static_cast<int64_t>(node_db::Arena::unpin(hint)));
+}
+
+// Chunks pinned by JS values are memory V8 keeps alive without knowing it,
+// so it is told about them to have collections account for it
+void node_db::ConversionPlan::adjustExternalMemory(int64_t change) {
+    if (change != 0) {
+        v8::V8::AdjustAmountOfExternalAllocatedMemory(static_cast<intptr_t>(change));
+    }
+}
+
+// Large ASCII cells flagged by the worker become external strings over the
+// arena, so their payload is never copied onto the V8 heap
+v8::Local<v8::Value> node_db::ConversionPlan::string(const char* value, unsigned long length, node_db::Arena* arena) const {
+    size_t pinned;
+    void* chunk = (arena != NULL ? arena->pin(value, length, &pinned) : NULL);
+    if (chunk != NULL) {
+        ConversionPlan::adjustExternalMemory(static_cast<int64_t>(pinned));
+        return v8::String::NewExternal(new ExternalString(value, length, chunk));
+    }
+
+    return v8::String::New(value, length);
+}
+
+// The worker already counted the members, so the array is allocated at its
+// final size and filled densely in a single pass
+v8::Local<v8::Value> node_db::ConversionPlan::set(uint16_t column, const char* value, unsigned long length, int64_t count) const {
+    v8::Local<v8::Array> values = v8::Array::New(static_cast<int>(count));
+    const char* current = value;
+    const char* end = value + length;
+    uint32_t index = 0;
+
+    while (current < end && index < count) {
+        const char* separator = static_cast<const char*>(memchr(current, ',', end - current));
+        if (separator == NULL) {
+            separator = end;
+        }
+
+        if (separator > current) {
+            values->Set(index++, this->member(column, current, separator - current));
+        }
+        current = separator + 1;
+    }
+
+    return values;
+}
+
+// SET members come from a short fixed list, so the strings for the first
+// ones seen are kept for the whole result and shared by every row
+v8::Local<v8::String> node_db::ConversionPlan::member(uint16_t column, const char* value, unsigned long length) const {
+    std::vector<member_t>& members = this->members[column];
+
+    for (std::vector<member_t>::iterator iterator = members.begin(), end = members.end(); iterator != end; ++iterator) {
+        if (iterator->value.size() == length && memcmp(iterator->value.data(), value, length) == 0) {
+            return NanPersistentToLocal(iterator->string);
+        }
+    }
+
+    v8::Local<v8::String> string = v8::String::New(value, length);
+
+    if (members.size() < 64) {
+        members.push_back(member_t());
+        members.back().value.assign(value, length);
+        NanAssignPersistent(v8::String, members.back().string, string);
+    }
+
+    return string;
+}
+
+// Cells the worker found in a column dictionary share the string built for
+// the first cell with the same entry
+v8::Local<v8::String> node_db::ConversionPlan::entry(uint16_t column, uint32_t entry, const char* value, unsigned long length) const {
+    std::vector< v8::Persistent<v8::String> >& entries = this->entries[column];
+    if (entry >= entries.size()) {
+        entries.resize(entry + 1);
+    }
+
+    if (entries[entry].IsEmpty()) {
+        NanAssignPersistent(v8::String, entries[entry], v8::String::New(value, length));
+    }
+
+    return NanPersistentToLocal(entries[entry]);
+}
+
+node_db::ConversionPlan::ExternalString::ExternalString(const char* value, size_t length, void* chunk)
+    :value(value),
+    size(length),
+    chunk(chunk) {
+}
+
+node_db::ConversionPlan::ExternalString::~ExternalString() {
+    ConversionPlan::adjustExternalMemory(-static_cast<int64_t>(node_db::Arena::unpin(this->chunk)));
+}
+
+const char* node_db::ConversionPlan::ExternalString::data() const {
+    return this->value;
+}
+
+size_t node_db::ConversionPlan::ExternalString::length() const {
+    return this->size;
+}
+
+bool node_db::ConversionPlan::isNumeric(converter_t converter) {
+    return (converter == INT || converter == NUMBER || converter == BIGINT);
+}
+
+bool node_db::ConversionPlan::isDecoded(converter_t converter) {
+    return (ConversionPlan::isNumeric(converter) || converter == TIME || converter == DATE || converter == DATETIME || converter == SET);
+}
+
+void node_db::ConversionPlan::decode(converter_t converter, const char* value, unsigned long length, number_t* number, node_db::DateCodec* dates) {
+    if (converter == SET) {
+        number->integer = ConversionPlan::countMembers(value, length);
+        return;
+    }
+
+    // Dates that can't be parsed are left as NaN and delivered as text
+    if (converter == TIME || converter == DATE || converter == DATETIME) {
+        bool parsed = (converter == TIME
+            ? node_db::DateCodec::parseTime(value, length, &(number->real))
+            : dates->parseDate(value, length, converter == DATETIME, &(number->real)));
+        if (!parsed) {
+            number->real = std::numeric_limits<double>::quiet_NaN();
+        }
+        return;
+    }
+
+    if (converter == BIGINT) {
+        // Out of range values keep a sentinel that is never a safe integer,
+        // so they are delivered as their original text
+        if (!ConversionPlan::parseInteger(value, length, &(number->integer))) {
+            number->integer = static_cast<int64_t>(static_cast<uint64_t>(1) << 63);
+        }
+        return;
+    }
+
+    int64_t integer;
+    if (converter == INT && ConversionPlan::parseInteger(value, length, &integer)) {
+        number->real = static_cast<double>(integer);
+        return;
+    }
+
+    // INT cells get what Value::ToInteger() used to give: truncated, with
+    // text that isn't a number as 0
+    number->real = ConversionPlan::parseNumber(value, length);
+    if (converter == INT) {
+        if (number->real != number->real) {
+            number->real = 0;
+        } else {
+            number->real = (number->real < 0 ? ceil(number->real) : floor(number->real));
+        }
+    }
+}
+
+bool node_db::ConversionPlan::isAscii(const char* value, unsigned long length) {
+    const char* current = value;
+    const char* end = value + length;
+
+    for (; end - current >= 8; current += 8) {
+        uint64_t word;
+        memcpy(&word, current, sizeof(word));
+        if (word & 0x8080808080808080ULL) {
+            return false;
+        }
+    }
+
+    for (; current < end; current++) {
+        if (*current & 0x80) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int64_t node_db::ConversionPlan::countMembers(const char* value, unsigned long length) {
+    const char* current = value;
+    const char* end = value + length;
+    int64_t count = 0;
+
+    while (current < end) {
+        const char* separator = static_cast<const char*>(memchr(current, ',', end - current));
+        if (separator == NULL) {
+            separator = end;
+        }
+
+        if (separator > current) {
+            count++;
+        }
+        current = separator + 1;
+    }
+
+    return count;
+}
+
+bool node_db::ConversionPlan::parseInteger(const char* value, unsigned long length, int64_t* result) {
+    const char* current = value;
+    const char* end = value + length;
+    bool negative = false;
+
+    if (current < end && (*current == '-' || *current == '+')) {
+        negative = (*current == '-');
+        current++;
+    }
+
+    if (current == end) {
+        return false;
+    }
+
+    const uint64_t limit = (static_cast<uint64_t>(1) << 63) - (negative ? 0 : 1);
+    uint64_t magnitude = 0;
+
+    for (; current < end; current++) {
+        if (*current < '0' || *current > '9') {
+            return false;
+        }
+
+        uint64_t digit = *current - '0';
+        if (magnitude > (limit - digit) / 10) {
+            return false;
+        }
+        magnitude = magnitude * 10 + digit;
+    }
+
+    *result = (negative ? -static_cast<int64_t>(magnitude - 1) - 1 : static_cast<int64_t>(magnitude));
+    return true;
+}
+
+// Same result as Value::ToNumber() on the cell text, which is what these
+// cells used to go through: surrounding whitespace is ignored, empty text
+// is 0, hexadecimal and Infinity are accepted, anything else that isn't a
+// number is NaN.
+double node_db::ConversionPlan::parseNumber(const char* value, unsigned long length) {
+    static const double powers[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char* current = value;
+    const char* end = value + length;
+    bool negative = false;
+
+    while (current < end && ConversionPlan::isSpace(*current)) {
+        current++;
+    }
+    while (end > current && ConversionPlan::isSpace(*(end - 1))) {
+        end--;
+    }
+    if (current == end) {
+        return 0;
+    }
+    const char* start = current;
+
+    if (end - current > 2 && current[0] == '0' && (current[1] == 'x' || current[1] == 'X')) {
+        double result = 0;
+        for (current += 2; current < end; current++) {
+            char digit = *current;
+            if (digit >= '0' && digit <= '9') {
+                result = result * 16 + (digit - '0');
+            } else if ((digit | 0x20) >= 'a' && (digit | 0x20) <= 'f') {
+                result = result * 16 + ((digit | 0x20) - 'a' + 10);
+            } else {
+                return std::numeric_limits<double>::quiet_NaN();
+            }
+        }
+        return result;
+    }
+
+    if (*current == '-' || *current == '+') {
+        negative = (*current == '-');
+        current++;
+    }
+
+    if (end - current == 8 && memcmp(current, "Infinity", 8) == 0) {
+        return (negative ? -std::numeric_limits<double>::infinity() : std::numeric_limits<double>::infinity());
+    }
+
+    // Plain decimals with up to 15 digits are exact in a double, and so is
+    // dividing them by a power of ten up to 1e22
+    uint64_t mantissa = 0;
+    int digits = 0, decimals = 0;
+    for (; current < end && *current >= '0' && *current <= '9'; current++, digits++) {
+        mantissa = mantissa * 10 + (*current - '0');
+    }
+    if (current < end && *current == '.') {
+        for (current++; current < end && *current >= '0' && *current <= '9'; current++, digits++, decimals++) {
+            mantissa = mantissa * 10 + (*current - '0');
+        }
+    }
+
+    if (digits == 0) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    if (current == end && digits <= 15) {
+        double result = static_cast<double>(mantissa) / powers[decimals];
+        return (negative ? -result : result);
+    }
+
+    if (current < end && (*current == 'e' || *current == 'E')) {
+        current++;
+        if (current < end && (*current == '-' || *current == '+')) {
+            current++;
+        }
+        if (current == end) {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        while (current < end && *current >= '0' && *current <= '9') {
+            current++;
+        }
+    }
+
+    if (current != end) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+
+    length = end - start;
+    char buffer[64];
+    if (length < sizeof(buffer)) {
+        memcpy(buffer, start, length);
+        buffer[length] = '\0';
+        return strtod(buffer, NULL);
+    }
+
+    return strtod(std::string(start, length).c_str(), NULL);
+}
+
+bool node_db::ConversionPlan::isSpace(char character) {
+    return (character == ' ' || (character >= '\t' && character <= '\r'));
+}
@@ -0,0 +1,95 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef PLAN_H_
+#define PLAN_H_
+
+#include <v8.h>
+#include <node.h>
+#include <node_buffer.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits>
+#include <string>
+#include <sstream>
+#include <vector>
+#include "./node_defs.h"
+#include "./arena.h"
+#include "./conversion.h"
+#include "./date.h"
+#include "./exception.h"
+#include "./result.h"
+#include "nan.h"
+
+namespace node_db {
+// Resolves once per result everything row materialization needs to know
+// about its columns (conversion, interned names, object shape), so the
+// per-cell loop only switches over precomputed converters. Plans are
+// reference counted since lazy rows may outlive the request that made them.
+class ConversionPlan : public Conversion {
+    public:
+        typedef enum {
+            BIGINT_STRING,
+            BIGINT_NUMBER,
+            BIGINT_EXACT
+        } bigint_t;
+
+        ConversionPlan(Result* result, bool cast, bool bufferText, bool arrays, bigint_t bigint, bool utc);
+        void retain();
+        void release();
+        uint16_t columnCount() const;
+        int column(v8::Local<v8::String> name) const;
+        v8::Local<v8::String> name(uint16_t column) const;
+        v8::Local<v8::Object> row(char** columns, unsigned long* columnLengths, const number_t* numbers, Arena* arena) const;
+        v8::Local<v8::Value> cell(uint16_t column, const char* value, unsigned long length, const number_t* number, Arena* arena) const;
+        static converter_t converter(Result::Column* column, bool cast, bool bufferText, bigint_t bigint);
+        static bool isNumeric(converter_t converter);
+        static bool isDecoded(converter_t converter);
+        static void decode(converter_t converter, const char* value, unsigned long length, number_t* number, DateCodec* dates);
+        static bool isAscii(const char* value, unsigned long length);
+        static int64_t countMembers(const char* value, unsigned long length);
+        static bool parseInteger(const char* value, unsigned long length, int64_t* result);
+        static double parseNumber(const char* value, unsigned long length);
+        static bool isSpace(char character);
+
+    protected:
+        class ExternalString : public v8::String::ExternalAsciiStringResource {
+            public:
+                ExternalString(const char* value, size_t length, void* chunk);
+                ~ExternalString();
+                const char* data() const;
+                size_t length() const;
+
+            protected:
+                const char* value;
+                size_t size;
+                void* chunk;
+        };
+
+        struct member_t {
+            std::string value;
+            v8::Persistent<v8::String> string;
+        };
+
+        std::vector<converter_t> converters;
+        std::vector< v8::Persistent<v8::String> > names;
+        v8::Persistent<v8::ObjectTemplate> objectTemplate;
+        mutable std::vector< std::vector<member_t> > members;
+        mutable std::vector< std::vector< v8::Persistent<v8::String> > > entries;
+        DateCodec* dates;
+        bool arrays;
+        int refs;
+
+        ~ConversionPlan();
+        v8::Local<v8::Value> buffer(const char* value, unsigned long length, Arena* arena) const;
+        v8::Local<v8::Value> string(const char* value, unsigned long length, Arena* arena) const;
+        v8::Local<v8::Value> set(uint16_t column, const char* value, unsigned long length, int64_t count) const;
+        v8::Local<v8::String> member(uint16_t column, const char* value, unsigned long length) const;
+        v8::Local<v8::String> entry(uint16_t column, uint32_t entry, const char* value, unsigned long length) const;
+        static void releaseBuffer(char* data, void* hint);
+        static void adjustExternalMemory(int64_t change);
+};
+}
+
+#endif  // PLAN_H_
@@ -0,0 +1,212 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./pool.h"
+
+node_db::ConnectionPool::Factory::~Factory() {
+}
+
+node_db::ConnectionPool::ConnectionPool(node_db::Connection* primary, const node_db::ConnectionPool::Factory* factory)
+    :primary(primary),
+    factory(factory),
+    min(1),
+    max(1),
+    engine(THREADPOOL),
+    open(false) {
+    this->connections.push_back(primary);
+    this->idle.push_back(primary);
+}
+
+node_db::ConnectionPool::~ConnectionPool() {
+    for (std::map<node_db::Connection*, node_db::WorkerThread*>::iterator iterator = this->workers.begin(), end = this->workers.end(); iterator != end; ++iterator) {
+        delete iterator->second;
+    }
+
+    for (std::vector<node_db::Connection*>::iterator iterator = this->connections.begin(), end = this->connections.end(); iterator != end; ++iterator) {
+        if (*iterator != this->primary) {
+            delete *iterator;
+        }
+    }
+}
+
+node_db::Connection* node_db::ConnectionPool::getPrimary() const {
+    return this->primary;
+}
+
+uint32_t node_db::ConnectionPool::getMin() const {
+    return this->min;
+}
+
+uint32_t node_db::ConnectionPool::getMax() const {
+    return this->max;
+}
+
+void node_db::ConnectionPool::setSize(uint32_t min, uint32_t max) throw(node_db::Exception&) {
+    if (max == 0) {
+        throw node_db::Exception("Pool size must allow at least one connection");
+    }
+    if (min > max) {
+        throw node_db::Exception("Minimum pool size can't be greater than maximum pool size");
+    }
+
+    // Drivers that can't pool return no connection from their factory, which
+    // is only found out by asking for one. A connection that does come back
+    // joins the pool right away.
+    if (max > 1 && this->connections.size() < 2) {
+        node_db::Connection* connection = (this->factory != NULL ? this->factory->createConnection() : NULL);
+        if (connection == NULL) {
+            throw node_db::Exception("Driver does not support pooling");
+        }
+
+        this->connections.push_back(connection);
+        this->checkin(connection);
+    }
+
+    this->min = (min > 0 ? min : 1);
+    this->max = max;
+}
+
+node_db::ConnectionPool::engine_t node_db::ConnectionPool::getEngine() const {
+    return this->engine;
+}
+
+void node_db::ConnectionPool::setEngine(engine_t engine) {
+    this->engine = engine;
+}
+
+node_db::Executor* node_db::ConnectionPool::executor(node_db::Connection* connection) {
+    if (this->engine != THREAD) {
+        return node_db::Executor::threadPool();
+    }
+
+    std::map<node_db::Connection*, node_db::WorkerThread*>::iterator iterator = this->workers.find(connection);
+    if (iterator != this->workers.end()) {
+        return iterator->second;
+    }
+
+    node_db::WorkerThread* worker;
+    try {
+        worker = new node_db::WorkerThread();
+    } catch(const node_db::Exception&) {
+        return node_db::Executor::threadPool();
+    }
+
+    this->workers[connection] = worker;
+    return worker;
+}
+
+uint32_t node_db::ConnectionPool::size() const {
+    return this->connections.size();
+}
+
+uint32_t node_db::ConnectionPool::idleCount() const {
+    return this->idle.size();
+}
+
+uint32_t node_db::ConnectionPool::waitingCount() const {
+    return this->waiting.size();
+}
+
+bool node_db::ConnectionPool::isOpen() const {
+    return this->open;
+}
+
+void node_db::ConnectionPool::setOpen(bool open) {
+    this->open = open;
+}
+
+std::vector<node_db::Connection*> node_db::ConnectionPool::fill() throw(node_db::Exception&) {
+    while (this->connections.size() < this->min) {
+        node_db::Connection* connection = this->grow();
+        if (connection == NULL) {
+            throw node_db::Exception("Could not create pooled connection");
+        }
+        this->idle.push_back(connection);
+    }
+
+    return this->connections;
+}
+
+void node_db::ConnectionPool::checkout(checkout_cb callback, void* data) {
+    node_db::Connection* connection = this->tryCheckout();
+    if (connection == NULL) {
+        waiter_t waiter;
+        waiter.callback = callback;
+        waiter.data = data;
+        this->waiting.push_back(waiter);
+        return;
+    }
+
+    callback(connection, data);
+}
+
+void node_db::ConnectionPool::checkout(node_db::Connection* connection, checkout_cb callback, void* data) {
+    if (!this->tryCheckout(connection)) {
+        waiter_t waiter;
+        waiter.callback = callback;
+        waiter.data = data;
+        this->submissions[connection].push_back(waiter);
+        return;
+    }
+
+    callback(connection, data);
+}
+
+node_db::Connection* node_db::ConnectionPool::tryCheckout() {
+    if (!this->idle.empty()) {
+        node_db::Connection* connection = this->idle.back();
+        this->idle.pop_back();
+        return connection;
+    }
+
+    return this->grow();
+}
+
+bool node_db::ConnectionPool::tryCheckout(node_db::Connection* connection) {
+    std::vector<node_db::Connection*>::iterator iterator = std::find(this->idle.begin(), this->idle.end(), connection);
+    if (iterator == this->idle.end()) {
+        return false;
+    }
+
+    this->idle.erase(iterator);
+    return true;
+}
+
+void node_db::ConnectionPool::checkin(node_db::Connection* connection) {
+    std::map< node_db::Connection*, std::deque<waiter_t> >::iterator submission = this->submissions.find(connection);
+    if (submission != this->submissions.end() && !submission->second.empty()) {
+        waiter_t waiter = submission->second.front();
+        submission->second.pop_front();
+        waiter.callback(connection, waiter.data);
+        return;
+    }
+
+    if (!this->waiting.empty()) {
+        waiter_t waiter = this->waiting.front();
+        this->waiting.pop_front();
+        waiter.callback(connection, waiter.data);
+        return;
+    }
+
+    this->idle.push_back(connection);
+}
+
+void node_db::ConnectionPool::close() {
+    for (std::vector<node_db::Connection*>::iterator iterator = this->connections.begin(), end = this->connections.end(); iterator != end; ++iterator) {
+        (*iterator)->close();
+    }
+
+    this->open = false;
+}
+
+node_db::Connection* node_db::ConnectionPool::grow() {
+    if (this->factory == NULL || this->connections.size() >= this->max) {
+        return NULL;
+    }
+
+    node_db::Connection* connection = this->factory->createConnection();
+    if (connection == NULL) {
+        return NULL;
+    }
+
+    this->connections.push_back(connection);
+    return connection;
+}
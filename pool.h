@@ -0,0 +1,76 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stdint.h>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+#include "./connection.h"
+#include "./exception.h"
+#include "./executor.h"
+
+namespace node_db {
+// Connections are checked out on the main thread before work is handed to a
+// worker, and queued checkouts are served as connections come back, so no
+// worker thread ever waits for a connection. Work that needs one particular
+// connection is queued on that connection's own submission queue.
+class ConnectionPool {
+    public:
+        typedef void (*checkout_cb)(Connection* connection, void* data);
+        typedef enum {
+            THREADPOOL,
+            THREAD
+        } engine_t;
+
+        class Factory {
+            public:
+                virtual ~Factory();
+                virtual Connection* createConnection() const = 0;
+        };
+
+        ConnectionPool(Connection* primary, const Factory* factory);
+        ~ConnectionPool();
+        Connection* getPrimary() const;
+        uint32_t getMin() const;
+        uint32_t getMax() const;
+        void setSize(uint32_t min, uint32_t max) throw(Exception&);
+        engine_t getEngine() const;
+        void setEngine(engine_t engine);
+        Executor* executor(Connection* connection);
+        uint32_t size() const;
+        uint32_t idleCount() const;
+        uint32_t waitingCount() const;
+        bool isOpen() const;
+        void setOpen(bool open);
+        std::vector<Connection*> fill() throw(Exception&);
+        void checkout(checkout_cb callback, void* data);
+        void checkout(Connection* connection, checkout_cb callback, void* data);
+        Connection* tryCheckout();
+        bool tryCheckout(Connection* connection);
+        void checkin(Connection* connection);
+        void close();
+
+    protected:
+        struct waiter_t {
+            checkout_cb callback;
+            void* data;
+        };
+        Connection* primary;
+        const Factory* factory;
+        std::vector<Connection*> connections;
+        std::vector<Connection*> idle;
+        std::deque<waiter_t> waiting;
+        std::map< Connection*, std::deque<waiter_t> > submissions;
+        std::map<Connection*, WorkerThread*> workers;
+        uint32_t min;
+        uint32_t max;
+        engine_t engine;
+        bool open;
+
+        Connection* grow();
+};
+}
+
+#endif  // POOL_H_
@@ -0,0 +1,141 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./projection.h"
+
+node_db::ProjectedResult::ProjectedResult(node_db::Result* result, const std::vector<std::string>& names) throw(node_db::Exception&)
+    :result(result),
+    resultLengths(NULL) {
+    uint16_t columnCount = result->columnCount();
+
+    for (std::vector<std::string>::const_iterator name = names.begin(), end = names.end(); name != end; ++name) {
+        uint16_t i = 0;
+        while (i < columnCount && result->column(i)->getName() != *name) {
+            i++;
+        }
+
+        if (i == columnCount) {
+            throw node_db::Exception("Column \"" + *name + "\" is not part of the result");
+        }
+
+        this->indexes.push_back(i);
+    }
+
+    this->row.resize(this->indexes.size());
+    this->lengths.resize(this->indexes.size());
+    this->typedValues.resize(this->indexes.size());
+}
+
+node_db::ProjectedResult::~ProjectedResult() {
+    delete this->result;
+}
+
+void node_db::ProjectedResult::release() throw() {
+    this->result->release();
+}
+
+bool node_db::ProjectedResult::hasNext() const throw(node_db::Exception&) {
+    return this->result->hasNext();
+}
+
+char** node_db::ProjectedResult::next() throw(node_db::Exception&) {
+    char** currentRow = this->result->next();
+    if (currentRow == NULL) {
+        return NULL;
+    }
+
+    for (std::vector<uint16_t>::size_type i = 0, limiti = this->indexes.size(); i < limiti; i++) {
+        this->row[i] = currentRow[this->indexes[i]];
+    }
+
+    // Lengths are read after the row is fetched, as callers of the wrapped
+    // result do when they ask for them before calling next()
+    if (this->resultLengths != NULL) {
+        for (std::vector<uint16_t>::size_type i = 0, limiti = this->indexes.size(); i < limiti; i++) {
+            this->lengths[i] = this->resultLengths[this->indexes[i]];
+        }
+    }
+
+    return &(this->row[0]);
+}
+
+unsigned long* node_db::ProjectedResult::columnLengths() throw(node_db::Exception&) {
+    this->resultLengths = this->result->columnLengths();
+
+    if (this->resultLengths != NULL) {
+        for (std::vector<uint16_t>::size_type i = 0, limiti = this->indexes.size(); i < limiti; i++) {
+            this->lengths[i] = this->resultLengths[this->indexes[i]];
+        }
+    }
+
+    return &(this->lengths[0]);
+}
+
+uint64_t node_db::ProjectedResult::index() const throw(std::out_of_range&) {
+    return this->result->index();
+}
+
+node_db::Result::Column* node_db::ProjectedResult::column(uint16_t i) const throw(std::out_of_range&) {
+    if (i >= this->indexes.size()) {
+        throw std::out_of_range("Wrong column index");
+    }
+
+    return this->result->column(this->indexes[i]);
+}
+
+uint64_t node_db::ProjectedResult::insertId() const throw(node_db::Exception&) {
+    return this->result->insertId();
+}
+
+uint64_t node_db::ProjectedResult::affectedCount() const throw() {
+    return this->result->affectedCount();
+}
+
+uint16_t node_db::ProjectedResult::warningCount() const throw(node_db::Exception&) {
+    return this->result->warningCount();
+}
+
+uint16_t node_db::ProjectedResult::columnCount() const throw() {
+    return this->indexes.size();
+}
+
+uint64_t node_db::ProjectedResult::count() const throw(node_db::Exception&) {
+    return this->result->count();
+}
+
+bool node_db::ProjectedResult::isBuffered() const throw() {
+    return this->result->isBuffered();
+}
+
+bool node_db::ProjectedResult::isEmpty() const throw() {
+    return this->result->isEmpty();
+}
+
+bool node_db::ProjectedResult::isBatched() const throw() {
+    return this->result->isBatched();
+}
+
+// The wrapped result adds its rows to the batch, which keeps the projected
+// columns of each as it goes
+size_t node_db::ProjectedResult::fetchBatch(node_db::RowBatch& batch, size_t maxRows) throw(node_db::Exception&) {
+    batch.select(&(this->indexes));
+    size_t fetched = this->result->fetchBatch(batch, maxRows);
+    batch.select(NULL);
+
+    return fetched;
+}
+
+bool node_db::ProjectedResult::isTyped() const throw() {
+    return this->result->isTyped();
+}
+
+const node_db::TypedValue* node_db::ProjectedResult::values() throw(node_db::Exception&) {
+    const node_db::TypedValue* values = this->result->values();
+    if (values == NULL) {
+        return NULL;
+    }
+
+    for (std::vector<uint16_t>::size_type i = 0, limiti = this->indexes.size(); i < limiti; i++) {
+        this->typedValues[i] = values[this->indexes[i]];
+    }
+
+    return &(this->typedValues[0]);
+}
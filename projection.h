@@ -0,0 +1,48 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef PROJECTION_H_
+#define PROJECTION_H_
+
+#include <stdint.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "./exception.h"
+#include "./result.h"
+
+namespace node_db {
+// Result that only exposes some columns of another one. Column names are
+// resolved once when it is created, and each row is narrowed to those
+// columns before anyone copies or converts it. It owns the wrapped result.
+class ProjectedResult : public Result {
+    public:
+        ProjectedResult(Result* result, const std::vector<std::string>& names) throw(Exception&);
+        ~ProjectedResult();
+        void release() throw();
+        bool hasNext() const throw(Exception&);
+        char** next() throw(Exception&);
+        unsigned long* columnLengths() throw(Exception&);
+        uint64_t index() const throw(std::out_of_range&);
+        Column* column(uint16_t i) const throw(std::out_of_range&);
+        uint64_t insertId() const throw(Exception&);
+        uint64_t affectedCount() const throw();
+        uint16_t warningCount() const throw(Exception&);
+        uint16_t columnCount() const throw();
+        uint64_t count() const throw(Exception&);
+        bool isBuffered() const throw();
+        bool isEmpty() const throw();
+        bool isBatched() const throw();
+        size_t fetchBatch(RowBatch& batch, size_t maxRows) throw(Exception&);
+        bool isTyped() const throw();
+        const TypedValue* values() throw(Exception&);
+
+    protected:
+        Result* result;
+        std::vector<uint16_t> indexes;
+        std::vector<char*> row;
+        std::vector<unsigned long> lengths;
+        std::vector<TypedValue> typedValues;
+        unsigned long* resultLengths;
+};
+}
+
+#endif  // PROJECTION_H_
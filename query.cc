@@ -1,17 +1,21 @@
 // Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
 // Copyright 2011 Georg Wicherski <gw@oxff.net>
 #include "./query.h"
-
-bool node_db::Query::gmtDeltaLoaded = false;
-int node_db::Query::gmtDelta;
+#include "./cursor.h"
 
 uv_async_t node_db::Query::g_async;
-
-v8::Local<v8::String> v8StringFromUInt64(uint64_t num, std::ostringstream &reusableStream) {
-    reusableStream.clear();
-    reusableStream.seekp(0);
-    reusableStream << num << std::ends;
-    return v8::String::New(reusableStream.str().c_str());
+v8::Persistent<v8::String> node_db::Query::syEach;
+v8::Persistent<v8::String> node_db::Query::syEachBatch;
+v8::Persistent<v8::String> node_db::Query::syRows;
+
+v8::Local<v8::String> v8StringFromUInt64(uint64_t num) {
+    char digits[20];
+    char* start = digits + sizeof(digits);
+    do {
+        *--start = static_cast<char>('0' + num % 10);
+        num /= 10;
+    } while (num > 0);
+    return v8::String::New(start, digits + sizeof(digits) - start);
 }
 
 void node_db::Query::Init(v8::Handle<v8::Object> target, v8::Local<v8::FunctionTemplate> constructorTemplate) {
@@ -30,10 +34,22 @@ void node_db::Query::Init(v8::Handle<v8::Object> target, v8::Local<v8::FunctionT
     NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "delete", Delete);
     NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "sql", Sql);
     NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "execute", Execute);
+    NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "cursor", OpenCursor);
+    NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "pause", Pause);
+    NODE_ADD_PROTOTYPE_METHOD(constructorTemplate, "resume", Resume);
+
+    node_db::EventEmitter::Init();
+    NanAssignPersistent(v8::String, syEach, v8::String::NewSymbol("each"));
+    NanAssignPersistent(v8::String, syEachBatch, v8::String::NewSymbol("eachBatch"));
+    NanAssignPersistent(v8::String, syRows, v8::String::NewSymbol("rows"));
+
+    node_db::Cursor::Init(target);
+    node_db::LazyRow::Init(target);
 }
 
 node_db::Query::Query(): node_db::EventEmitter(),
-    connection(NULL), async(true), cast(true), bufferText(false), cbStart(NULL), cbExecute(NULL), cbFinish(NULL) {
+    connection(NULL), pool(NULL), async(true), cast(true), bufferText(false), stream(false), highWaterMark(1000), eachBatchSize(1000), sliceRows(0), sliceTime(0),
+    layout(ROWS), rowMode(OBJECTS), format(VALUES), lazy(false), bigint(node_db::ConversionPlan::BIGINT_STRING), dates(new node_db::DateCodec()), parameterDates(new node_db::DateCodec(false)), externalStrings(0), dictionary(false), paused(false), streamRequest(NULL), cbStart(NULL), cbExecute(NULL), cbFinish(NULL) {
 }
 
 node_db::Query::~Query() {
@@ -50,12 +66,19 @@ node_db::Query::~Query() {
     if (this->cbFinish != NULL) {
         delete this->cbFinish;
     }
+
+    delete this->dates;
+    delete this->parameterDates;
 }
 
 void node_db::Query::setConnection(node_db::Connection* connection) {
     this->connection = connection;
 }
 
+void node_db::Query::setPool(node_db::ConnectionPool* pool) {
+    this->pool = pool;
+}
+
 NAN_METHOD(node_db::Query::Select) {
     NanScope();
 
@@ -637,7 +660,7 @@ NAN_METHOD(node_db::Query::Execute) {
         THROW_EXCEPTION("Can't execute a query without being connected")
     }
 
-    execute_request_t *request = new execute_request_t();
+    execute_request_t *request = query->createRequest(args.This());
     if (request == NULL) {
         THROW_EXCEPTION("Could not create EIO request")
     }
@@ -646,19 +669,21 @@ NAN_METHOD(node_db::Query::Execute) {
     query->sql.clear();
     query->sql << sql;
 
-    NanAssignPersistent(v8::Object, request->context, args.This());
-    request->query = query;
-    request->buffered = false;
-    request->result = NULL;
-    request->rows = NULL;
-    request->error = NULL;
+    request->streaming = (query->async && query->stream);
+
+    if (request->streaming) {
+        query->paused = false;
+        query->streamRequest = request;
+    }
 
     if (query->async) {
         request->query->Ref();
 
-        uv_work_t* req = new uv_work_t();
-        req->data = request;
-        uv_queue_work(uv_default_loop(), req, uvExecute, (uv_after_work_cb)uvExecuteFinished);
+        if (query->pool != NULL) {
+            query->pool->checkout(checkedOut, request);
+        } else {
+            checkedOut(query->connection, request);
+        }
 
 #if NODE_VERSION_AT_LEAST(0, 7, 9)
         uv_ref((uv_handle_t *)&g_async);
@@ -673,141 +698,521 @@ NAN_METHOD(node_db::Query::Execute) {
     NanReturnValue(v8::Undefined());
 }
 
-void node_db::Query::uvExecute(uv_work_t* uvRequest) {
-    execute_request_t *request = static_cast<execute_request_t *>(uvRequest->data);
+NAN_METHOD(node_db::Query::OpenCursor) {
+    NanScope();
+
+    node_db::Query *query = node::ObjectWrap::Unwrap<node_db::Query>(args.This());
+    assert(query);
+
+    if (args.Length() > 0) {
+        v8::Handle<v8::Value> set = query->set(args);
+        if (!set.IsEmpty()) {
+            NanReturnValue(set);
+        }
+    }
+
+    std::string sql;
+
+    try {
+        sql = query->parseQuery();
+    } catch(const node_db::Exception& exception) {
+        THROW_EXCEPTION(exception.what())
+    }
+
+    if (!query->connection->isAlive(false)) {
+        THROW_EXCEPTION("Can't open a cursor without being connected")
+    }
+
+    execute_request_t *request = query->createRequest(args.This());
+    if (request == NULL) {
+        THROW_EXCEPTION("Could not create EIO request")
+    }
+
+    query->sql.str("");
+    query->sql.clear();
+    query->sql << sql;
+
+    request->fetching = false;
+    request->format = VALUES;
+    request->layout = query->layout;
+    request->lazy = (query->lazy && query->layout == ROWS);
+
+    NanReturnValue(node_db::Cursor::create(request));
+}
+
+NAN_METHOD(node_db::Query::Pause) {
+    NanScope();
+
+    node_db::Query *query = node::ObjectWrap::Unwrap<node_db::Query>(args.This());
+    assert(query);
+
+    query->paused = true;
+
+    NanReturnValue(args.This());
+}
+
+NAN_METHOD(node_db::Query::Resume) {
+    NanScope();
+
+    node_db::Query *query = node::ObjectWrap::Unwrap<node_db::Query>(args.This());
+    assert(query);
+
+    query->paused = false;
+    if (query->streamRequest != NULL && !query->streamRequest->fetching) {
+        query->fetch(query->streamRequest);
+    }
+
+    NanReturnValue(args.This());
+}
+
+node_db::Query::execute_request_t* node_db::Query::createRequest(v8::Local<v8::Object> context) {
+    execute_request_t *request = new execute_request_t();
+    if (request == NULL) {
+        return NULL;
+    }
+
+    NanAssignPersistent(v8::Object, request->context, context);
+    request->query = this;
+    request->connection = NULL;
+    request->connect = false;
+    request->buffered = false;
+    request->projected = false;
+    request->format = this->format;
+    request->lazy = (this->lazy && this->layout == ROWS && this->format == VALUES);
+    request->streaming = false;
+    request->fetching = true;
+    request->finished = false;
+    request->highWaterMark = this->highWaterMark;
+    request->index = 0;
+    request->layout = (this->format == VALUES ? this->layout : ROWS);
+    request->result = NULL;
+    request->rows = NULL;
+    request->columnar = NULL;
+    request->plan = NULL;
+    request->dates = NULL;
+    request->dictionaries = NULL;
+    request->arena = NULL;
+    request->output = NULL;
+    request->outputLength = 0;
+    request->arrow = NULL;
+    request->materializedRows = 0;
+    request->error = NULL;
+
+    return request;
+}
+
+void node_db::Query::checkedOut(node_db::Connection* connection, void* data) {
+    execute_request_t *request = static_cast<execute_request_t *>(data);
     assert(request);
 
+    request->connection = connection;
+    request->connect = (request->query->pool != NULL && request->query->pool->isOpen());
+
+    request->query->executor(connection)->submit(uvExecute, uvExecuteFinished, request);
+}
+
+void node_db::Query::uvExecute(void* data) {
+    execute_request_t *request = static_cast<execute_request_t *>(data);
+    assert(request);
+
+    node_db::Connection* connection = request->connection;
+
     try {
-        request->query->connection->lock();
-        request->result = request->query->execute();
-        request->query->connection->unlock();
-
-        if (!request->result->isEmpty() && request->result != NULL) {
-            request->rows = new std::vector<row_t*>();
-            if (request->rows == NULL) {
-                throw node_db::Exception("Could not create buffer for rows");
+        if (!connection->isAlive()) {
+            if (!request->connect) {
+                throw node_db::Exception("Can't execute a query without being connected");
             }
+            connection->open();
+        }
 
+        request->result = request->query->execute(connection);
+        request->query->project(request);
+
+        if (request->result != NULL && !request->result->isEmpty()) {
             request->buffered = request->result->isBuffered();
             request->columnCount = request->result->columnCount();
-            while (request->result->hasNext()) {
-                unsigned long* columnLengths = request->result->columnLengths();
-                char** currentRow = request->result->next();
 
-                row_t* row = new row_t();
-                if (row == NULL) {
-                    throw node_db::Exception("Could not create buffer for row");
-                }
+            Query::fetchRows(request, request->streaming ? request->highWaterMark : 0);
+            Query::decodeColumns(request);
+            Query::serializeRows(request);
+        }
+    } catch(const node_db::Exception& exception) {
+        Query::freeRequest(request, false);
+        request->error = new std::string(exception.what());
+    }
+}
 
-                row->columnLengths = new unsigned long[request->columnCount];
-                if (row->columnLengths == NULL) {
-                    throw node_db::Exception("Could not create buffer for column lengths");
-                }
+void node_db::Query::uvFetch(void* data) {
+    execute_request_t *request = static_cast<execute_request_t *>(data);
+    assert(request);
 
-                if (request->buffered) {
-                    row->columns = currentRow;
+    try {
+        Query::fetchRows(request, request->highWaterMark);
+        Query::decodeColumns(request);
+        Query::serializeRows(request);
+    } catch(const node_db::Exception& exception) {
+        Query::freeRows(request);
+        request->error = new std::string(exception.what());
+    }
+}
 
-                    for (uint16_t i = 0; i < request->columnCount; i++) {
-                        row->columnLengths[i] = columnLengths[i];
+void node_db::Query::fetchRows(execute_request_t* request, uint32_t limit) throw(node_db::Exception&) {
+    request->rows = new std::vector<row_t*>();
+    if (request->rows == NULL) {
+        throw node_db::Exception("Could not create buffer for rows");
+    }
+    // limit comes from the user (highWaterMark, cursor.fetch()), so only a
+    // first batch worth is reserved and the vector grows past it as needed
+    if (limit > 0) {
+        request->rows->reserve(std::min(limit, static_cast<uint32_t>(1024)));
+    }
+
+    if (request->arena == NULL) {
+        request->arena = new node_db::Arena();
+    }
+    node_db::Arena* arena = request->arena;
+
+    std::vector<node_db::ConversionPlan::converter_t> converters(request->columnCount);
+    bool decode = false;
+    for (uint16_t i = 0; i < request->columnCount; i++) {
+        converters[i] = request->query->converter(request->result->column(i));
+        decode = decode || node_db::ConversionPlan::isDecoded(converters[i]);
+    }
+
+    // Large ASCII strings can only be external when they live in the arena
+    uint32_t externalStrings = (request->buffered ? 0 : request->query->externalStrings);
+    if (externalStrings > 0 || request->query->dictionary) {
+        for (uint16_t i = 0; i < request->columnCount; i++) {
+            decode = decode || converters[i] == node_db::ConversionPlan::STRING;
+        }
+    }
+
+    // Dictionaries outlive each batch, so entries stay the same across a stream
+    if (request->query->dictionary && request->dictionaries == NULL) {
+        request->dictionaries = new std::vector<node_db::Dictionary>(request->columnCount);
+    }
+
+    bool batched = request->result->isBatched();
+    node_db::RowBatch batch(request->columnCount, arena, !request->buffered || request->lazy);
+    const uint32_t batchRows = 1024;
+
+    // Typed cells that are converted as text after all need their column
+    // type and the date zone to be formatted. Batches may carry values
+    // whether or not the result says it is typed
+    bool typed = request->result->isTyped();
+    std::vector<node_db::Result::Column::type_t> types;
+    types.reserve(request->columnCount);
+    for (uint16_t i = 0; i < request->columnCount; i++) {
+        types.push_back(request->result->column(i)->getType());
+    }
+
+    if ((decode || typed || batched) && request->dates == NULL) {
+        request->dates = new node_db::DateCodec(request->query->dates->isUtc());
+    }
+
+    uint32_t fetched = 0;
+    while (limit == 0 || fetched < limit) {
+        // Batched drivers add several rows per call straight into the arena,
+        // everyone else hands out one row at a time that is copied below
+        size_t count;
+        char** cells = NULL;
+        unsigned long* cellLengths = NULL;
+        const node_db::TypedValue* rowValues = NULL;
+        if (batched) {
+            batch.clear();
+            count = request->result->fetchBatch(batch, limit > 0 ? std::min(limit - fetched, batchRows) : batchRows);
+            if (count == 0) {
+                break;
+            }
+        } else {
+            if (!request->result->hasNext()) {
+                break;
+            }
+            count = 1;
+            cellLengths = request->result->columnLengths();
+            cells = request->result->next();
+            if (typed) {
+                rowValues = request->result->values();
+            }
+        }
+        fetched += count;
+
+        for (size_t r = 0; r < count; r++) {
+            row_t* row = arena->allocate<row_t>(1);
+            row->numbers = NULL;
+
+            if (batched) {
+                row->columns = batch.columns(r);
+                row->columnLengths = batch.columnLengths(r);
+            } else {
+                row->columnLengths = arena->allocate<unsigned long>(request->columnCount);
+                memcpy(row->columnLengths, cellLengths, request->columnCount * sizeof(unsigned long));
+
+                // Lazy rows outlive the result, so they always own a copy of
+                // it. Projected rows are views the result reuses, so only
+                // their pointers are copied when the cells stay where they
+                // are, as they are for typed rows, whose pointers may be
+                // replaced below.
+                if (request->buffered && !request->lazy) {
+                    if (request->projected || typed) {
+                        row->columns = arena->allocate<char*>(request->columnCount);
+                        memcpy(row->columns, cells, request->columnCount * sizeof(char*));
+                    } else {
+                        row->columns = cells;
                     }
                 } else {
-                    row->columns = new char*[request->columnCount];
-                    if (row->columns == NULL) {
-                        throw node_db::Exception("Could not create buffer for columns");
-                    }
+                    row->columns = arena->allocate<char*>(request->columnCount);
 
                     for (uint16_t i = 0; i < request->columnCount; i++) {
-                        row->columnLengths[i] = columnLengths[i];
-                        if (currentRow[i] != NULL) {
-                            row->columns[i] = new char[row->columnLengths[i]];
-                            if (row->columns[i] == NULL) {
-                                throw node_db::Exception("Could not create buffer for column");
-                            }
-                            memcpy(row->columns[i], currentRow[i], row->columnLengths[i]);
+                        if (cells[i] != NULL) {
+                            row->columns[i] = arena->allocate<char>(row->columnLengths[i]);
+                            memcpy(row->columns[i], cells[i], row->columnLengths[i]);
                         } else {
                             row->columns[i] = NULL;
                         }
                     }
                 }
+            }
 
-                request->rows->push_back(row);
+            // Typed cells skip parsing, and only get text when they are
+            // converted as text anyway or are BIGINTs JS can't hold
+            const node_db::TypedValue* values = (batched ? batch.values(r) : rowValues);
+            if (values != NULL) {
+                for (uint16_t i = 0; i < request->columnCount; i++) {
+                    node_db::ConversionPlan::number_t number;
+                    if (row->columns[i] == NULL || values[i].type == node_db::TypedValue::TEXT
+                        || (node_db::ConversionPlan::assign(converters[i], values[i], &number)
+                            && (converters[i] != node_db::ConversionPlan::BIGINT || node_db::ConversionPlan::isSafeInteger(number.integer)))) {
+                        continue;
+                    }
+
+                    char text[64];
+                    row->columnLengths[i] = node_db::ConversionPlan::format(values[i], types[i], request->dates, text);
+                    row->columns[i] = arena->allocate<char>(row->columnLengths[i]);
+                    memcpy(row->columns[i], text, row->columnLengths[i]);
+                }
             }
 
-            if (!request->result->isBuffered()) {
-                request->result->release();
+            if (decode) {
+                row->numbers = arena->allocate<node_db::ConversionPlan::number_t>(request->columnCount);
+                memset(row->numbers, 0, request->columnCount * sizeof(node_db::ConversionPlan::number_t));
+
+                for (uint16_t i = 0; i < request->columnCount; i++) {
+                    if (row->columns[i] == NULL) {
+                        continue;
+                    }
+
+                    if (values != NULL && values[i].type != node_db::TypedValue::TEXT
+                        && node_db::ConversionPlan::assign(converters[i], values[i], &(row->numbers[i]))) {
+                        continue;
+                    }
+
+                    if (node_db::ConversionPlan::isDecoded(converters[i])) {
+                        node_db::ConversionPlan::decode(converters[i], row->columns[i], row->columnLengths[i], &(row->numbers[i]), request->dates);
+                    } else if (converters[i] == node_db::ConversionPlan::STRING) {
+                        if (request->dictionaries != NULL) {
+                            row->numbers[i].text.entry = (*request->dictionaries)[i].find(row->columns[i], row->columnLengths[i]);
+                        }
+                        if (externalStrings > 0 && row->numbers[i].text.entry == 0 && row->columnLengths[i] >= externalStrings) {
+                            row->numbers[i].text.ascii = node_db::ConversionPlan::isAscii(row->columns[i], row->columnLengths[i]);
+                        }
+                    }
+                }
             }
+
+            request->rows->push_back(row);
         }
-    } catch(const node_db::Exception& exception) {
-        request->query->connection->unlock();
-        Query::freeRequest(request, false);
-        request->error = new std::string(exception.what());
     }
+
+    if (!request->result->hasNext()) {
+        request->finished = true;
+
+        if (!request->result->isBuffered()) {
+            request->result->release();
+        }
+    }
+}
+
+void node_db::Query::decodeColumns(execute_request_t* request) throw(node_db::Exception&) {
+    if (request->layout != COLUMNAR || request->rows == NULL) {
+        return;
+    }
+
+    size_t totalRows = request->rows->size();
+
+    request->columnar = new std::vector<column_t>(request->columnCount);
+    if (request->columnar == NULL) {
+        throw node_db::Exception("Could not create buffer for columns");
+    }
+
+    for (uint16_t i = 0; i < request->columnCount; i++) {
+        column_t& column = (*request->columnar)[i];
+        column.numbers = NULL;
+        column.integers = NULL;
+        column.validity = NULL;
+
+        node_db::ConversionPlan::converter_t converter = request->query->converter(request->result->column(i));
+        if (!node_db::ConversionPlan::isNumeric(converter)) {
+            continue;
+        }
+
+        column.numbers = new double[totalRows];
+        column.validity = new uint8_t[(totalRows + 7) / 8];
+        if (column.numbers == NULL || column.validity == NULL) {
+            throw node_db::Exception("Could not create buffer for column");
+        }
+        memset(column.validity, 0, (totalRows + 7) / 8);
+
+        bool hasNulls = false, exact = true, integer = (converter == node_db::ConversionPlan::INT);
+        for (size_t j = 0; j < totalRows && exact; j++) {
+            row_t* row = (*request->rows)[j];
+            if (row->columns[i] == NULL) {
+                column.numbers[j] = 0;
+                hasNulls = true;
+                continue;
+            }
+
+            double number;
+            if (converter == node_db::ConversionPlan::BIGINT) {
+                exact = node_db::ConversionPlan::isSafeInteger(row->numbers[i].integer);
+                number = static_cast<double>(row->numbers[i].integer);
+            } else {
+                number = row->numbers[i].real;
+            }
+
+            if (integer && (number < -2147483648.0 || number > 2147483647.0 || number != static_cast<int32_t>(number))) {
+                integer = false;
+            }
+
+            column.numbers[j] = number;
+            column.validity[j >> 3] |= static_cast<uint8_t>(1 << (j & 7));
+        }
+
+        // BIGINT columns holding values a double can't represent exactly are
+        // left to the per cell conversion, which keeps them as strings
+        if (!exact) {
+            delete [] column.numbers;
+            delete [] column.validity;
+            column.numbers = NULL;
+            column.validity = NULL;
+            continue;
+        }
+
+        // Values that all fit are handed to JS as an Int32Array instead
+        if (integer) {
+            column.integers = new int32_t[totalRows];
+            if (column.integers == NULL) {
+                throw node_db::Exception("Could not create buffer for column");
+            }
+            for (size_t j = 0; j < totalRows; j++) {
+                column.integers[j] = static_cast<int32_t>(column.numbers[j]);
+            }
+            delete [] column.numbers;
+            column.numbers = NULL;
+        }
+
+        if (!hasNulls) {
+            delete [] column.validity;
+            column.validity = NULL;
+        }
+    }
+}
+
+void node_db::Query::serializeRows(execute_request_t* request) throw(node_db::Exception&) {
+    if (request->format == VALUES || request->rows == NULL) {
+        return;
+    }
+
+    std::vector<node_db::ConversionPlan::converter_t> converters(request->columnCount);
+    for (uint16_t i = 0; i < request->columnCount; i++) {
+        converters[i] = request->query->converter(request->result->column(i));
+    }
+
+    // Arrow output needs the schema and batch offsets of previous batches,
+    // so its writer lives as long as the request
+    if (request->format == ARROW || request->format == ARROW_FILE) {
+        if (request->arrow == NULL) {
+            request->arrow = new node_db::ArrowWriter(request->result, converters, request->format == ARROW_FILE);
+        }
+        for (std::vector<row_t*>::iterator iterator = request->rows->begin(), end = request->rows->end(); iterator != end; ++iterator) {
+            request->arrow->row((*iterator)->columns, (*iterator)->columnLengths, (*iterator)->numbers);
+        }
+        request->arrow->flush(request->finished);
+
+        request->output = request->arrow->release(&request->outputLength);
+        return;
+    }
+
+    // Streamed batches are pieces of one document: only the first opens it
+    // and only the last closes it
+    node_db::JsonWriter writer(request->result, converters, request->query->rowMode == ARRAYS, request->format == NDJSON);
+    writer.begin(request->index == 0);
+    for (std::vector<row_t*>::iterator iterator = request->rows->begin(), end = request->rows->end(); iterator != end; ++iterator) {
+        writer.row((*iterator)->columns, (*iterator)->columnLengths, (*iterator)->numbers);
+    }
+    writer.end(request->finished);
+
+    request->output = writer.release(&request->outputLength);
 }
 
-void node_db::Query::uvExecuteFinished(uv_work_t* uvRequest, int status) {
+node_db::ConversionPlan::converter_t node_db::Query::converter(node_db::Result::Column* column) const {
+    return node_db::ConversionPlan::converter(column, this->cast, this->bufferText, this->bigint);
+}
+
+void node_db::Query::uvExecuteFinished(void* data) {
     NanScope();
 
-    execute_request_t *request = static_cast<execute_request_t *>(uvRequest->data);
+    execute_request_t *request = static_cast<execute_request_t *>(data);
     assert(request);
 
-    if (request->error == NULL && request->result != NULL) {
+    if (request->streaming && request->error == NULL && request->result != NULL && !request->result->isEmpty()) {
+        if (!request->query->streamRows(request)) {
+            return;
+        }
+    } else if (request->error == NULL && request->result != NULL) {
         v8::Local<v8::Value> argv[3];
         argv[0] = v8::Local<v8::Value>::New(v8::Null());
 
         bool isEmpty = request->result->isEmpty();
-        if (!isEmpty) {
+        if (!isEmpty && request->format != VALUES) {
+            argv[1] = request->query->output(request);
+            argv[2] = request->query->columns(request->result);
+        } else if (!isEmpty && request->layout == COLUMNAR) {
+            assert(request->rows);
+
+            argv[1] = request->query->columnar(request);
+            argv[2] = request->query->columns(request->result);
+        } else if (!isEmpty && (request->query->sliceRows > 0 || request->query->sliceTime > 0)) {
+            assert(request->rows);
+
+            // Large results are converted over several loop iterations,
+            // and delivered by the slice that converts their last row
+            NanAssignPersistent(v8::Array, request->materialized, v8::Array::New(request->rows->size()));
+            node_db::TimeSlicer::run(Query::materialize, request, request->query->sliceRows, request->query->sliceTime);
+            return;
+        } else if (!isEmpty) {
             assert(request->rows);
 
             size_t totalRows = request->rows->size();
             v8::Local<v8::Array> rows = v8::Array::New(totalRows);
 
-            uint64_t index = 0;
-            std::ostringstream reusableStream;
+            uint32_t index = 0;
             for (std::vector<row_t*>::iterator iterator = request->rows->begin(), end = request->rows->end(); iterator != end; ++iterator, index++) {
-                row_t* currentRow = *iterator;
-                v8::Local<v8::Object> row = request->query->row(request->result, currentRow);
-                v8::Local<v8::Value> eachArgv[3];
-
-                eachArgv[0] = row;
-                eachArgv[1] = v8StringFromUInt64(index, reusableStream);
-                eachArgv[2] = v8::Local<v8::Value>::New((index == totalRows - 1) ? v8::True() : v8::False());
-
-                request->query->Emit("each", 3, eachArgv);
-
-                rows->Set(index, row);
-            }
-
-            v8::Local<v8::Array> columns = v8::Array::New(request->columnCount);
-            for (uint16_t j = 0; j < request->columnCount; j++) {
-                node_db::Result::Column *currentColumn = request->result->column(j);
-
-                v8::Local<v8::Object> column = v8::Object::New();
-                column->Set(v8::String::New("name"), v8::String::New(currentColumn->getName().c_str()));
-                column->Set(v8::String::New("type"), NODE_CONSTANT(currentColumn->getType()));
-
-                columns->Set(j, column);
+                rows->Set(index, request->query->row(request, *iterator));
             }
+            request->query->emitRows(rows, totalRows, 0, true);
 
             argv[1] = rows;
-            argv[2] = columns;
+            argv[2] = request->query->columns(request->result);
         } else {
             v8::Local<v8::Object> result = v8::Object::New();
-            std::ostringstream reusableStream;
-            result->Set(v8::String::New("id"), v8StringFromUInt64(request->result->insertId(), reusableStream));
-            result->Set(v8::String::New("affected"), v8StringFromUInt64(request->result->affectedCount(), reusableStream));
-            result->Set(v8::String::New("warning"), v8StringFromUInt64(request->result->warningCount(), reusableStream));
+            result->Set(v8::String::New("id"), v8StringFromUInt64(request->result->insertId()));
+            result->Set(v8::String::New("affected"), v8StringFromUInt64(request->result->affectedCount()));
+            result->Set(v8::String::New("warning"), v8StringFromUInt64(request->result->warningCount()));
             argv[1] = result;
         }
 
-        request->query->Emit("success", !isEmpty ? 2 : 1, &argv[1]);
-
-        if (request->query->cbExecute != NULL && !request->query->cbExecute->GetFunction().IsEmpty()) {
-            v8::TryCatch tryCatch;
-            (*(request->query->cbExecute->GetFunction()))->Call(NanPersistentToLocal(request->context), !isEmpty ? 3 : 2, argv);
-            if (tryCatch.HasCaught()) {
-                node::FatalException(tryCatch);
-            }
-        }
+        Query::executeSucceeded(request, !isEmpty ? 3 : 2, argv);
     } else {
         v8::Local<v8::Value> argv[1];
         argv[0] = v8::String::New(request->error != NULL ? request->error->c_str() : "(unknown error)");
@@ -823,6 +1228,22 @@ void node_db::Query::uvExecuteFinished(uv_work_t* uvRequest, int status) {
         }
     }
 
+    Query::executeCompleted(request);
+}
+
+void node_db::Query::executeSucceeded(execute_request_t* request, int argc, v8::Local<v8::Value> argv[]) {
+    request->query->Emit("success", argc - 1, &argv[1]);
+
+    if (request->query->cbExecute != NULL && !request->query->cbExecute->GetFunction().IsEmpty()) {
+        v8::TryCatch tryCatch;
+        (*(request->query->cbExecute->GetFunction()))->Call(NanPersistentToLocal(request->context), argc, argv);
+        if (tryCatch.HasCaught()) {
+            node::FatalException(tryCatch);
+        }
+    }
+}
+
+void node_db::Query::executeCompleted(execute_request_t* request) {
     if (request->query->cbFinish != NULL && !request->query->cbFinish->GetFunction().IsEmpty()) {
         v8::TryCatch tryCatch;
         (*(request->query->cbFinish->GetFunction()))->Call(v8::Context::GetCurrent()->Global(), 0, NULL);
@@ -837,27 +1258,366 @@ void node_db::Query::uvExecuteFinished(uv_work_t* uvRequest, int status) {
     uv_unref(uv_default_loop());
 #endif
 
+    node_db::ConnectionPool* pool = request->query->pool;
+    node_db::Connection* connection = request->connection;
+
+    if (request->query->streamRequest == request) {
+        request->query->streamRequest = NULL;
+    }
+
     request->query->Unref();
 
     Query::freeRequest(request);
+
+    if (pool != NULL) {
+        pool->checkin(connection);
+    }
+}
+
+bool node_db::Query::materialize(void* data, uint32_t rows) {
+    NanScope();
+
+    execute_request_t *request = static_cast<execute_request_t *>(data);
+    assert(request);
+
+    v8::Local<v8::Array> materialized = NanPersistentToLocal(request->materialized);
+    size_t totalRows = request->rows->size();
+    size_t end = std::min(totalRows, static_cast<size_t>(request->materializedRows) + rows);
+
+    for (; request->materializedRows < end; request->materializedRows++) {
+        materialized->Set(request->materializedRows, request->query->row(request, (*request->rows)[request->materializedRows]));
+    }
+
+    if (request->materializedRows < totalRows) {
+        return true;
+    }
+
+    request->query->emitRows(materialized, totalRows, 0, true);
+
+    v8::Local<v8::Value> argv[3];
+    argv[0] = v8::Local<v8::Value>::New(v8::Null());
+    argv[1] = materialized;
+    argv[2] = request->query->columns(request->result);
+
+    Query::executeSucceeded(request, 3, argv);
+    Query::executeCompleted(request);
+
+    return false;
+}
+
+// Emits "each" once per row and "eachBatch" once per eachBatchSize rows,
+// only for the events somebody listens to
+void node_db::Query::emitRows(v8::Local<v8::Array> rows, uint32_t count, uint64_t start, bool finished) {
+    if (count == 0) {
+        return;
+    }
+
+    if (this->HasListeners(NanPersistentToLocal(syEach))) {
+        v8::Local<v8::String> each = NanPersistentToLocal(syEach);
+        for (uint32_t index = 0; index < count; index++) {
+            v8::Local<v8::Value> argv[3];
+
+            argv[0] = rows->Get(index);
+            argv[1] = v8StringFromUInt64(start + index);
+            argv[2] = v8::Local<v8::Value>::New((finished && index == count - 1) ? v8::True() : v8::False());
+
+            this->Emit(each, 3, argv);
+        }
+    }
+
+    if (this->HasListeners(NanPersistentToLocal(syEachBatch))) {
+        v8::Local<v8::String> eachBatch = NanPersistentToLocal(syEachBatch);
+        for (uint32_t first = 0; first < count; first += this->eachBatchSize) {
+            uint32_t size = std::min(this->eachBatchSize, count - first);
+            v8::Local<v8::Array> batch = v8::Array::New(size);
+            v8::Local<v8::Value> argv[3];
+
+            for (uint32_t index = 0; index < size; index++) {
+                batch->Set(index, rows->Get(first + index));
+            }
+
+            argv[0] = batch;
+            argv[1] = v8::Number::New(static_cast<double>(start + first));
+            argv[2] = v8::Local<v8::Value>::New((finished && first + size == count) ? v8::True() : v8::False());
+
+            this->Emit(eachBatch, 3, argv);
+        }
+    }
+}
+
+bool node_db::Query::streamRows(execute_request_t* request) {
+    size_t totalRows = request->rows->size();
+    bool deliver = (totalRows > 0 || request->output != NULL);
+    v8::Local<v8::Value> rows;
+
+    if (request->format != VALUES) {
+        rows = this->output(request);
+    } else if (request->layout == COLUMNAR) {
+        rows = this->columnar(request);
+    } else {
+        v8::Local<v8::Array> objects = v8::Array::New(totalRows);
+
+        uint32_t index = 0;
+        for (std::vector<row_t*>::iterator iterator = request->rows->begin(), end = request->rows->end(); iterator != end; ++iterator, index++) {
+            objects->Set(index, this->row(request, *iterator));
+        }
+        this->emitRows(objects, totalRows, request->index, request->finished);
+
+        rows = objects;
+    }
+
+    request->index += totalRows;
+    Query::freeRows(request);
+
+    if (deliver) {
+        v8::Local<v8::Value> argv[2];
+        argv[0] = rows;
+        argv[1] = this->columns(request->result);
+
+        this->Emit(NanPersistentToLocal(syRows), 2, argv);
+    }
+
+    // Still fetching while the events above run, so a listener calling
+    // resume() doesn't start a second fetch next to this one
+    request->fetching = false;
+
+    if (!request->finished) {
+        if (!this->paused) {
+            this->fetch(request);
+        }
+        return false;
+    }
+
+    this->Emit("end", 0, NULL);
+
+    if (this->cbExecute != NULL && !this->cbExecute->GetFunction().IsEmpty()) {
+        v8::Local<v8::Value> argv[1];
+        argv[0] = v8::Local<v8::Value>::New(v8::Null());
+
+        v8::TryCatch tryCatch;
+        (*(this->cbExecute->GetFunction()))->Call(NanPersistentToLocal(request->context), 1, argv);
+        if (tryCatch.HasCaught()) {
+            node::FatalException(tryCatch);
+        }
+    }
+
+    return true;
+}
+
+void node_db::Query::fetch(execute_request_t* request) {
+    request->fetching = true;
+    this->executor(request->connection)->submit(uvFetch, uvExecuteFinished, request);
+}
+
+node_db::Executor* node_db::Query::executor(node_db::Connection* connection) const {
+    return (this->pool != NULL ? this->pool->executor(connection) : node_db::Executor::threadPool());
+}
+
+void node_db::Query::project(execute_request_t* request) const throw(node_db::Exception&) {
+    if (this->projection.empty() || request->result == NULL || request->result->isEmpty()) {
+        return;
+    }
+
+    try {
+        request->result = new node_db::ProjectedResult(request->result, this->projection);
+    } catch(const node_db::Exception& exception) {
+        delete request->result;
+        request->result = NULL;
+        throw;
+    }
+
+    request->projected = true;
+}
+
+v8::Local<v8::Array> node_db::Query::columns(node_db::Result* result) const {
+    uint16_t columnCount = result->columnCount();
+    v8::Local<v8::Array> columns = v8::Array::New(columnCount);
+
+    for (uint16_t j = 0; j < columnCount; j++) {
+        node_db::Result::Column *currentColumn = result->column(j);
+
+        v8::Local<v8::Object> column = v8::Object::New();
+        column->Set(v8::String::New("name"), v8::String::New(currentColumn->getName().c_str()));
+        column->Set(v8::String::New("type"), NODE_CONSTANT(currentColumn->getType()));
+
+        columns->Set(j, column);
+    }
+
+    return columns;
+}
+
+node_db::ConversionPlan* node_db::Query::plan(execute_request_t* request) const {
+    if (request->plan == NULL) {
+        request->plan = new node_db::ConversionPlan(request->result, this->cast, this->bufferText, this->rowMode == ARRAYS, this->bigint, this->dates->isUtc());
+    }
+
+    return request->plan;
+}
+
+v8::Local<v8::Object> node_db::Query::row(execute_request_t* request, row_t* row) const {
+    node_db::ConversionPlan* plan = this->plan(request);
+
+    if (request->lazy) {
+        return node_db::LazyRow::create(plan, row->columns, row->columnLengths, row->numbers, request->arena);
+    }
+
+    return plan->row(row->columns, row->columnLengths, row->numbers, request->arena);
+}
+
+v8::Local<v8::Array> node_db::Query::columnar(execute_request_t* request) const {
+    uint32_t totalRows = request->rows->size();
+    uint32_t validityLength = (totalRows + 7) / 8;
+    v8::Local<v8::Array> columns = v8::Array::New(request->columnCount);
+    std::vector<uint8_t> validity(validityLength);
+    node_db::ConversionPlan* plan = this->plan(request);
+
+    for (uint16_t i = 0; i < request->columnCount; i++) {
+        node_db::Result::Column* currentColumn = request->result->column(i);
+        column_t* decoded = (request->columnar != NULL ? &(*request->columnar)[i] : NULL);
+        v8::Local<v8::Value> values, nulls = v8::Local<v8::Value>::New(v8::Null());
+
+        if (decoded != NULL && (decoded->integers != NULL || decoded->numbers != NULL)) {
+            if (decoded->integers != NULL) {
+                values = Query::typedArray("Int32Array", decoded->integers, totalRows, sizeof(int32_t));
+            } else {
+                values = Query::typedArray("Float64Array", decoded->numbers, totalRows, sizeof(double));
+            }
+
+            if (decoded->validity != NULL) {
+                nulls = Query::typedArray("Uint8Array", decoded->validity, validityLength, sizeof(uint8_t));
+            }
+        } else {
+            v8::Local<v8::Array> cells = v8::Array::New(totalRows);
+            bool hasNulls = false;
+
+            std::fill(validity.begin(), validity.end(), 0);
+            for (uint32_t j = 0; j < totalRows; j++) {
+                row_t* row = (*request->rows)[j];
+                if (row->columns[i] == NULL) {
+                    hasNulls = true;
+                } else {
+                    validity[j >> 3] |= static_cast<uint8_t>(1 << (j & 7));
+                }
+                cells->Set(j, plan->cell(i, row->columns[i], row->columnLengths[i], row->numbers != NULL ? &(row->numbers[i]) : NULL, request->arena));
+            }
+
+            values = cells;
+            if (hasNulls) {
+                nulls = Query::typedArray("Uint8Array", &validity[0], validityLength, sizeof(uint8_t));
+            }
+        }
+
+        v8::Local<v8::Object> column = v8::Object::New();
+        column->Set(v8::String::New("name"), v8::String::New(currentColumn->getName().c_str()));
+        column->Set(v8::String::New("values"), values);
+        column->Set(v8::String::New("validity"), nulls);
+
+        columns->Set(i, column);
+    }
+
+    return columns;
+}
+
+v8::Local<v8::Object> node_db::Query::output(execute_request_t* request) const {
+    if (request->output == NULL) {
+        return NanNewBufferHandle(0);
+    }
+
+    // The serialized text is handed over to the Buffer without a copy
+    v8::Local<v8::Object> buffer = NanNewBufferHandle(request->output, request->outputLength, Query::freeOutput, NULL);
+    request->output = NULL;
+    request->outputLength = 0;
+
+    return buffer;
+}
+
+void node_db::Query::freeOutput(char* data, void* hint) {
+    free(data);
+}
+
+v8::Local<v8::Object> node_db::Query::typedArray(const char* type, const void* data, uint32_t length, size_t size) {
+    v8::Local<v8::Function> constructor = v8::Local<v8::Function>::Cast(v8::Context::GetCurrent()->Global()->Get(v8::String::NewSymbol(type)));
+
+    v8::Local<v8::Value> argv[1];
+    argv[0] = v8::Integer::NewFromUnsigned(length);
+
+    v8::Local<v8::Object> array = constructor->NewInstance(1, argv);
+    if (length > 0) {
+        memcpy(array->GetIndexedPropertiesExternalArrayData(), data, length * size);
+    }
+
+    return array;
 }
 
 void node_db::Query::executeAsync(execute_request_t* request) {
     bool freeAll = true;
+
+    node_db::Connection* connection = NULL;
+    if (this->pool != NULL) {
+        connection = this->pool->tryCheckout();
+    } else {
+        connection = this->connection;
+    }
+    request->connection = connection;
+
     try {
-        this->connection->lock();
-        request->result = this->execute();
-        this->connection->unlock();
+        if (connection == NULL) {
+            throw node_db::Exception("Can't execute a synchronous query while all connections are busy");
+        }
+
+        if (!connection->isAlive()) {
+            connection->open();
+        }
+
+        request->result = this->execute(connection);
+        this->project(request);
 
         if (request->result != NULL) {
             v8::Local<v8::Value> argv[3];
             argv[0] = v8::Local<v8::Value>::New(v8::Null());
 
             bool isEmpty = request->result->isEmpty();
-            if (!isEmpty) {
+            if (!isEmpty && request->layout == COLUMNAR) {
+                request->buffered = request->result->isBuffered();
                 request->columnCount = request->result->columnCount();
 
-                v8::Local<v8::Array> columns = v8::Array::New(request->columnCount);
+                Query::fetchRows(request, 0);
+                Query::decodeColumns(request);
+
+                argv[1] = this->columnar(request);
+                argv[2] = this->columns(request->result);
+            } else if (!isEmpty && request->format != VALUES) {
+                request->buffered = request->result->isBuffered();
+                request->columnCount = request->result->columnCount();
+
+                Query::fetchRows(request, 0);
+                Query::serializeRows(request);
+
+                argv[1] = this->output(request);
+                argv[2] = this->columns(request->result);
+            } else if (!isEmpty && (request->lazy || request->result->isTyped())) {
+                // Typed cells are only read by fetchRows()
+                request->buffered = request->result->isBuffered();
+                request->columnCount = request->result->columnCount();
+
+                Query::fetchRows(request, 0);
+
+                size_t totalRows = request->rows->size();
+                v8::Local<v8::Array> rows = v8::Array::New(totalRows);
+
+                uint32_t index = 0;
+                for (std::vector<row_t*>::iterator iterator = request->rows->begin(), end = request->rows->end(); iterator != end; ++iterator, index++) {
+                    rows->Set(index, this->row(request, *iterator));
+                }
+                this->emitRows(rows, totalRows, 0, true);
+
+                argv[1] = rows;
+                argv[2] = this->columns(request->result);
+            } else if (!isEmpty) {
+                request->columnCount = request->result->columnCount();
+
+                node_db::ConversionPlan* plan = this->plan(request);
+                v8::Local<v8::Array> columns = this->columns(request->result);
                 v8::Local<v8::Array> rows;
                 try {
                     rows = v8::Array::New(request->result->count());
@@ -865,35 +1625,16 @@ void node_db::Query::executeAsync(execute_request_t* request) {
                     rows = v8::Array::New();
                 }
 
-                for (uint16_t i = 0; i < request->columnCount; i++) {
-                    node_db::Result::Column *currentColumn = request->result->column(i);
-
-                    v8::Local<v8::Object> column = v8::Object::New();
-                    column->Set(v8::String::New("name"), v8::String::New(currentColumn->getName().c_str()));
-                    column->Set(v8::String::New("type"), NODE_CONSTANT(currentColumn->getType()));
-
-                    columns->Set(i, column);
-                }
-
                 row_t row;
-                uint64_t index = 0;
-                std::ostringstream reusableStream;
+                uint32_t index = 0;
 
                 while (request->result->hasNext()) {
                     row.columnLengths = (unsigned long*) request->result->columnLengths();
                     row.columns = reinterpret_cast<char**>(request->result->next());
 
-                    v8::Local<v8::Object> jsRow = this->row(request->result, &row);
-                    v8::Local<v8::Value> eachArgv[3];
-
-                    eachArgv[0] = jsRow;
-                    eachArgv[1] = v8StringFromUInt64(index, reusableStream);
-                    eachArgv[2] = v8::Local<v8::Value>::New(request->result->hasNext() ? v8::True() : v8::False());
-
-                    this->Emit("each", 3, eachArgv);
-
-                    rows->Set(index++, jsRow);
+                    rows->Set(index++, plan->row(row.columns, row.columnLengths, NULL, NULL));
                 }
+                this->emitRows(rows, index, 0, true);
 
                 if (!request->result->isBuffered()) {
                     request->result->release();
@@ -903,10 +1644,9 @@ void node_db::Query::executeAsync(execute_request_t* request) {
                 argv[2] = columns;
             } else {
                 v8::Local<v8::Object> result = v8::Object::New();
-                std::ostringstream reusableStream;
-                result->Set(v8::String::New("id"), v8StringFromUInt64(request->result->insertId(), reusableStream));
-                result->Set(v8::String::New("affected"), v8StringFromUInt64(request->result->affectedCount(), reusableStream));
-                result->Set(v8::String::New("warning"), v8StringFromUInt64(request->result->warningCount(), reusableStream));
+                result->Set(v8::String::New("id"), v8StringFromUInt64(request->result->insertId()));
+                result->Set(v8::String::New("affected"), v8StringFromUInt64(request->result->affectedCount()));
+                result->Set(v8::String::New("warning"), v8StringFromUInt64(request->result->warningCount()));
                 argv[1] = result;
             }
 
@@ -921,8 +1661,6 @@ void node_db::Query::executeAsync(execute_request_t* request) {
             }
         }
     } catch(const node_db::Exception& exception) {
-        this->connection->unlock();
-
         v8::Local<v8::Value> argv[1];
         argv[0] = v8::String::New(exception.what());
 
@@ -940,40 +1678,82 @@ void node_db::Query::executeAsync(execute_request_t* request) {
     }
 
     Query::freeRequest(request, freeAll);
+
+    if (this->pool != NULL && connection != NULL) {
+        this->pool->checkin(connection);
+    }
 }
 
 node_db::Result* node_db::Query::execute() const throw(node_db::Exception&) {
-    return this->connection->query(this->sql.str());
+    return this->execute(this->connection);
 }
 
-void node_db::Query::freeRequest(execute_request_t* request, bool freeAll) {
+node_db::Result* node_db::Query::execute(node_db::Connection* connection) const throw(node_db::Exception&) {
+    return connection->query(this->sql.str());
+}
+
+void node_db::Query::freeRows(execute_request_t* request) {
     if (request->rows != NULL) {
-        for (std::vector<row_t*>::iterator iterator = request->rows->begin(), end = request->rows->end(); iterator != end; ++iterator) {
-            row_t* row = *iterator;
-            if (!request->buffered) {
-                for (uint16_t i = 0; i < request->columnCount; i++) {
-                    if (row->columns[i] != NULL) {
-                        delete row->columns[i];
-                    }
-                }
-                delete [] row->columns;
-            }
-            delete [] row->columnLengths;
-            delete row;
+        delete request->rows;
+        request->rows = NULL;
+    }
+
+    if (request->arena != NULL) {
+        request->arena->clear();
+    }
+
+    if (request->output != NULL) {
+        free(request->output);
+        request->output = NULL;
+        request->outputLength = 0;
+    }
+
+    if (request->columnar != NULL) {
+        for (std::vector<column_t>::iterator iterator = request->columnar->begin(), end = request->columnar->end(); iterator != end; ++iterator) {
+            delete [] iterator->numbers;
+            delete [] iterator->integers;
+            delete [] iterator->validity;
         }
 
-        delete request->rows;
+        delete request->columnar;
+        request->columnar = NULL;
     }
+}
+
+void node_db::Query::freeRequest(execute_request_t* request, bool freeAll) {
+    Query::freeRows(request);
 
     if (request->error != NULL) {
         delete request->error;
+        request->error = NULL;
     }
 
     if (freeAll) {
+        if (request->plan != NULL) {
+            request->plan->release();
+        }
+
+        if (request->dates != NULL) {
+            delete request->dates;
+        }
+
+        if (request->dictionaries != NULL) {
+            delete request->dictionaries;
+        }
+
+        if (request->arrow != NULL) {
+            delete request->arrow;
+        }
+
+        if (request->arena != NULL) {
+            delete request->arena;
+        }
+
         if (request->result != NULL) {
             delete request->result;
         }
 
+        NanDispose(request->materialized);
         NanDispose(request->context);
 
         delete request;
@@ -1070,6 +1850,20 @@ v8::Local<v8::Value> node_db::Query::set(_NAN_METHOD_ARGS) {
         ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, async);
         ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, cast);
         ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, bufferText);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, stream);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_UINT32(options, highWaterMark);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_UINT32(options, eachBatchSize);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_UINT32(options, sliceRows);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_UINT32(options, sliceTime);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_STRING(options, layout);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_STRING(options, rowMode);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_STRING(options, format);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, lazy);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_ARRAY(options, columns);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_STRING(options, bigint);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_STRING(options, timezone);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_UINT32(options, externalStrings);
+        ARG_CHECK_OBJECT_ATTR_OPTIONAL_BOOL(options, dictionary);
         ARG_CHECK_OBJECT_ATTR_OPTIONAL_FUNCTION(options, start);
         ARG_CHECK_OBJECT_ATTR_OPTIONAL_FUNCTION(options, finish);
 
@@ -1085,6 +1879,130 @@ v8::Local<v8::Value> node_db::Query::set(_NAN_METHOD_ARGS) {
             this->bufferText = options->Get(bufferText_key)->IsTrue();
         }
 
+        if (options->Has(stream_key)) {
+            this->stream = options->Get(stream_key)->IsTrue();
+        }
+
+        if (options->Has(highWaterMark_key)) {
+            this->highWaterMark = options->Get(highWaterMark_key)->Uint32Value();
+            if (this->highWaterMark == 0) {
+                THROW_EXCEPTION("Option \"highWaterMark\" must be greater than 0")
+            }
+        }
+
+        if (options->Has(eachBatchSize_key)) {
+            this->eachBatchSize = options->Get(eachBatchSize_key)->Uint32Value();
+            if (this->eachBatchSize == 0) {
+                THROW_EXCEPTION("Option \"eachBatchSize\" must be greater than 0")
+            }
+        }
+
+        if (options->Has(sliceRows_key)) {
+            this->sliceRows = options->Get(sliceRows_key)->Uint32Value();
+        }
+
+        if (options->Has(sliceTime_key)) {
+            this->sliceTime = options->Get(sliceTime_key)->Uint32Value();
+        }
+
+        if (options->Has(layout_key)) {
+            v8::String::Utf8Value layout(options->Get(layout_key)->ToString());
+            std::string currentLayout = *layout;
+            if (currentLayout == "rows") {
+                this->layout = ROWS;
+            } else if (currentLayout == "columnar") {
+                this->layout = COLUMNAR;
+            } else {
+                THROW_EXCEPTION("Option \"layout\" must be either \"rows\" or \"columnar\"")
+            }
+        }
+
+        if (options->Has(rowMode_key)) {
+            v8::String::Utf8Value rowMode(options->Get(rowMode_key)->ToString());
+            std::string currentRowMode = *rowMode;
+            if (currentRowMode == "object") {
+                this->rowMode = OBJECTS;
+            } else if (currentRowMode == "array") {
+                this->rowMode = ARRAYS;
+            } else {
+                THROW_EXCEPTION("Option \"rowMode\" must be either \"object\" or \"array\"")
+            }
+        }
+
+        if (options->Has(format_key)) {
+            v8::String::Utf8Value format(options->Get(format_key)->ToString());
+            std::string currentFormat = *format;
+            if (currentFormat == "values") {
+                this->format = VALUES;
+            } else if (currentFormat == "json") {
+                this->format = JSON;
+            } else if (currentFormat == "ndjson") {
+                this->format = NDJSON;
+            } else if (currentFormat == "arrow") {
+                this->format = ARROW;
+            } else if (currentFormat == "arrow-file") {
+                this->format = ARROW_FILE;
+            } else {
+                THROW_EXCEPTION("Option \"format\" must be one of \"values\", \"json\", \"ndjson\", \"arrow\" or \"arrow-file\"")
+            }
+        }
+
+        if (options->Has(lazy_key)) {
+            this->lazy = options->Get(lazy_key)->IsTrue();
+        }
+
+        if (options->Has(columns_key)) {
+            v8::Local<v8::Array> columns = options->Get(columns_key).As<v8::Array>();
+            this->projection.clear();
+            for (uint32_t i = 0, limiti = columns->Length(); i < limiti; i++) {
+                v8::Local<v8::Value> column = columns->Get(i);
+                if (!column->IsString()) {
+                    THROW_EXCEPTION("Option \"columns\" must be an array of column names")
+                }
+
+                v8::String::Utf8Value columnName(column);
+                this->projection.push_back(*columnName);
+            }
+        }
+
+        if (this->lazy && this->rowMode == ARRAYS) {
+            THROW_EXCEPTION("Option \"lazy\" is only supported for object rows")
+        }
+
+        if (options->Has(bigint_key)) {
+            v8::String::Utf8Value bigint(options->Get(bigint_key)->ToString());
+            std::string currentBigint = *bigint;
+            if (currentBigint == "string") {
+                this->bigint = node_db::ConversionPlan::BIGINT_STRING;
+            } else if (currentBigint == "number") {
+                this->bigint = node_db::ConversionPlan::BIGINT_NUMBER;
+            } else if (currentBigint == "exact") {
+                this->bigint = node_db::ConversionPlan::BIGINT_EXACT;
+            } else {
+                THROW_EXCEPTION("Option \"bigint\" must be one of \"string\", \"number\" or \"exact\"")
+            }
+        }
+
+        if (options->Has(timezone_key)) {
+            v8::String::Utf8Value timezone(options->Get(timezone_key)->ToString());
+            std::string currentTimezone = *timezone;
+            if (currentTimezone == "local") {
+                this->dates->setUtc(false);
+            } else if (currentTimezone == "utc") {
+                this->dates->setUtc(true);
+            } else {
+                THROW_EXCEPTION("Option \"timezone\" must be either \"local\" or \"utc\"")
+            }
+        }
+
+        if (options->Has(externalStrings_key)) {
+            this->externalStrings = options->Get(externalStrings_key)->Uint32Value();
+        }
+
+        if (options->Has(dictionary_key)) {
+            this->dictionary = options->Get(dictionary_key)->IsTrue();
+        }
+
         if (options->Has(start_key)) {
             if (this->cbStart != NULL) {
                 delete this->cbStart;
@@ -1253,125 +2171,6 @@ v8::Handle<v8::Value> node_db::Query::addCondition(_NAN_METHOD_ARGS, const char*
     return NanThrowError(v8::String::New(message));
 
 
-v8::Local<v8::Object> node_db::Query::row(node_db::Result* result, row_t* currentRow) const {
-    v8::Local<v8::Object> row = v8::Object::New();
-
-    for (uint16_t j = 0, limitj = result->columnCount(); j < limitj; j++) {
-        node_db::Result::Column* currentColumn = result->column(j);
-        v8::Local<v8::Value> value;
-
-        if (currentRow->columns[j] != NULL) {
-            const char* currentValue = currentRow->columns[j];
-            unsigned long currentLength = currentRow->columnLengths[j];
-            if (this->cast) {
-                node_db::Result::Column::type_t columnType = currentColumn->getType();
-                switch (columnType) {
-                    case node_db::Result::Column::BOOL:
-                        value = v8::Local<v8::Value>::New(currentValue == NULL || currentLength == 0 || currentValue[0] != '0' ? v8::True() : v8::False());
-                        break;
-                    case node_db::Result::Column::INT:
-                        value = v8::String::New(currentValue, currentLength)->ToInteger();
-                        break;
-                    case node_db::Result::Column::NUMBER:
-                        value = v8::String::New(currentValue, currentLength)->ToNumber();
-                        break;
-                    case node_db::Result::Column::TIME:
-                        {
-                            int hour, min, sec;
-                            sscanf(currentValue, "%d:%d:%d", &hour, &min, &sec);
-                            value = v8::Date::New(static_cast<uint64_t>((hour*60*60 + min*60 + sec) * 1000));
-                        }
-                        break;
-                    case node_db::Result::Column::DATE:
-                    case node_db::Result::Column::DATETIME:
-                        // Code largely inspired from https://github.com/Sannis/node-mysql-libmysqlclient
-                        try {
-                            int day = 0, month = 0, year = 0, hour = 0, min = 0, sec = 0;
-                            time_t rawtime;
-                            struct tm timeinfo;
-
-                            if (columnType == node_db::Result::Column::DATETIME) {
-                                sscanf(currentValue, "%d-%d-%d %d:%d:%d", &year, &month, &day, &hour, &min, &sec);
-                            } else {
-                                sscanf(currentValue, "%d-%d-%d", &year, &month, &day);
-                            }
-
-                            time(&rawtime);
-                            if (!localtime_r(&rawtime, &timeinfo)) {
-                                throw node_db::Exception("Can't get local time");
-                            }
-
-                            if (!Query::gmtDeltaLoaded) {
-                                int localHour, gmtHour, localMin, gmtMin;
-
-                                localHour = timeinfo.tm_hour - (timeinfo.tm_isdst > 0 ? 1 : 0);
-                                localMin = timeinfo.tm_min;
-
-                                if (!gmtime_r(&rawtime, &timeinfo)) {
-                                    throw node_db::Exception("Can't get GMT time");
-                                }
-                                gmtHour = timeinfo.tm_hour;
-                                gmtMin = timeinfo.tm_min;
-
-                                Query::gmtDelta = ((localHour - gmtHour) * 60 + (localMin - gmtMin)) * 60;
-                                if (Query::gmtDelta <= -(12 * 60 * 60)) {
-                                    Query::gmtDelta += 24 * 60 * 60;
-                                } else if (Query::gmtDelta > (12 * 60 * 60)) {
-                                    Query::gmtDelta -= 24 * 60 * 60;
-                                }
-                                Query::gmtDeltaLoaded = true;
-                            }
-
-                            timeinfo.tm_year = year - 1900;
-                            timeinfo.tm_mon = month - 1;
-                            timeinfo.tm_mday = day;
-                            timeinfo.tm_hour = hour;
-                            timeinfo.tm_min = min;
-                            timeinfo.tm_sec = sec;
-
-                            value = v8::Date::New(static_cast<double>(mktime(&timeinfo) + Query::gmtDelta) * 1000);
-                        } catch(const node_db::Exception&) {
-                            value = v8::String::New(currentValue, currentLength);
-                        }
-                        break;
-                    case node_db::Result::Column::SET:
-                        {
-                            v8::Local<v8::Array> values = v8::Array::New();
-                            std::istringstream stream(currentValue);
-                            std::string item;
-                            uint64_t index = 0;
-                            std::ostringstream reusableStream;
-                            while (std::getline(stream, item, ',')) {
-                                if (!item.empty()) {
-                                    values->Set(v8StringFromUInt64(index++, reusableStream), v8::String::New(item.c_str()));
-                                }
-                            }
-                            value = values;
-                        }
-                        break;
-                    case node_db::Result::Column::TEXT:
-                        if (this->bufferText || currentColumn->isBinary()) {
-                            value = v8::Local<v8::Value>::New(node::Buffer::New(v8::String::New(currentValue, currentLength)));
-                        } else {
-                            value = v8::String::New(currentValue, currentLength);
-                        }
-                        break;
-                    default:
-                        value = v8::String::New(currentValue, currentLength);
-                        break;
-                }
-            } else {
-                value = v8::String::New(currentValue, currentLength);
-            }
-        } else {
-            value = v8::Local<v8::Value>::New(v8::Null());
-        }
-        row->Set(v8::String::New(currentColumn->getName().c_str()), value);
-    }
-
-    return row;
-}
-
 std::vector<std::string::size_type> node_db::Query::placeholders(std::string* parsed) const throw(node_db::Exception&) {
     std::string query = this->sql.str();
     std::vector<std::string::size_type> positions;
@@ -1525,24 +2324,8 @@ std::string node_db::Query::value(v8::Local<v8::Value> value, bool inArray, bool
     return currentStream.str();
 }
 
+// Date parameters are written as local wall clock time, as they always
+// were, whatever zone the query reads its results in
 std::string node_db::Query::fromDate(const double timeStamp) const throw(node_db::Exception&) {
-    char* buffer = new char[20];
-    if (buffer == NULL) {
-        throw node_db::Exception("Can\'t create buffer to write parsed date");
-    }
-
-
-    struct tm timeinfo;
-    time_t rawtime = (time_t) (timeStamp / 1000);
-    if (!localtime_r(&rawtime, &timeinfo)) {
-        throw node_db::Exception("Can't get local time");
-    }
-
-    strftime(buffer, 20, "%Y-%m-%d %H:%M:%S", &timeinfo);
-
-    std::string date(buffer);
-    delete [] buffer;
-
-    return date;
+    return this->parameterDates->format(timeStamp);
 }
-
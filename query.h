@@ -14,39 +14,112 @@
 #include <sstream>
 #include <vector>
 #include "./node_defs.h"
+#include "./arena.h"
+#include "./arrow.h"
 #include "./connection.h"
+#include "./date.h"
+#include "./dictionary.h"
 #include "./events.h"
 #include "./exception.h"
+#include "./json.h"
+#include "./lazy.h"
+#include "./plan.h"
+#include "./pool.h"
+#include "./projection.h"
 #include "./result.h"
+#include "./slicer.h"
 #include "nan.h"
 
 namespace node_db {
 class Query : public EventEmitter {
+    friend class Cursor;
+
     public:
         static void Init(v8::Handle<v8::Object> target, v8::Local<v8::FunctionTemplate> constructorTemplate);
         void setConnection(Connection* connection);
+        void setPool(ConnectionPool* pool);
         v8::Local<v8::Value> set(_NAN_METHOD_ARGS);
 
     protected:
+        typedef enum {
+            ROWS,
+            COLUMNAR
+        } layout_t;
+        typedef enum {
+            OBJECTS,
+            ARRAYS
+        } rowmode_t;
+        typedef enum {
+            VALUES,
+            JSON,
+            NDJSON,
+            ARROW,
+            ARROW_FILE
+        } format_t;
         struct row_t {
             char** columns;
             unsigned long* columnLengths;
+            ConversionPlan::number_t* numbers;
+        };
+        struct column_t {
+            double* numbers;
+            int32_t* integers;
+            uint8_t* validity;
         };
         struct execute_request_t {
             v8::Persistent<v8::Object> context;
             Query* query;
+            Connection* connection;
+            bool connect;
             Result* result;
             std::string* error;
             uint16_t columnCount;
             bool buffered;
+            bool projected;
+            bool lazy;
+            bool streaming;
+            bool fetching;
+            bool finished;
+            uint32_t highWaterMark;
+            uint64_t index;
+            layout_t layout;
+            format_t format;
             std::vector<row_t*>* rows;
+            std::vector<column_t>* columnar;
+            ConversionPlan* plan;
+            DateCodec* dates;
+            std::vector<Dictionary>* dictionaries;
+            Arena* arena;
+            char* output;
+            size_t outputLength;
+            ArrowWriter* arrow;
+            v8::Persistent<v8::Array> materialized;
+            uint32_t materializedRows;
         };
         Connection* connection;
+        ConnectionPool* pool;
         std::ostringstream sql;
         std::vector< v8::Persistent<v8::Value> > values;
         bool async;
         bool cast;
         bool bufferText;
+        bool stream;
+        uint32_t highWaterMark;
+        uint32_t eachBatchSize;
+        uint32_t sliceRows;
+        uint32_t sliceTime;
+        layout_t layout;
+        rowmode_t rowMode;
+        format_t format;
+        bool lazy;
+        std::vector<std::string> projection;
+        ConversionPlan::bigint_t bigint;
+        DateCodec* dates;
+        DateCodec* parameterDates;
+        uint32_t externalStrings;
+        bool dictionary;
+        bool paused;
+        execute_request_t* streamRequest;
         NanCallback *cbStart;
         NanCallback *cbExecute;
         NanCallback *cbFinish;
@@ -68,25 +141,51 @@ class Query : public EventEmitter {
         static NAN_METHOD(Delete);
         static NAN_METHOD(Sql);
         static NAN_METHOD(Execute);
+        static NAN_METHOD(OpenCursor);
+        static NAN_METHOD(Pause);
+        static NAN_METHOD(Resume);
         static uv_async_t g_async;
-        static void uvExecute(uv_work_t* uvRequest);
-        static void uvExecuteFinished(uv_work_t* uvRequest, int status);
+        static v8::Persistent<v8::String> syEach;
+        static v8::Persistent<v8::String> syEachBatch;
+        static v8::Persistent<v8::String> syRows;
+        execute_request_t* createRequest(v8::Local<v8::Object> context);
+        static void checkedOut(Connection* connection, void* data);
+        static void uvExecute(void* data);
+        static void uvExecuteFinished(void* data);
+        static void executeSucceeded(execute_request_t* request, int argc, v8::Local<v8::Value> argv[]);
+        static void executeCompleted(execute_request_t* request);
+        static bool materialize(void* data, uint32_t rows);
+        static void uvFetch(void* data);
+        static void fetchRows(execute_request_t* request, uint32_t limit) throw(Exception&);
+        static void decodeColumns(execute_request_t* request) throw(Exception&);
+        static void serializeRows(execute_request_t* request) throw(Exception&);
+        bool streamRows(execute_request_t* request);
+        void emitRows(v8::Local<v8::Array> rows, uint32_t count, uint64_t start, bool finished);
+        void fetch(execute_request_t* request);
+        Executor* executor(Connection* connection) const;
+        void project(execute_request_t* request) const throw(Exception&);
         void executeAsync(execute_request_t* request);
+        static void freeRows(execute_request_t* request);
         static void freeRequest(execute_request_t* request, bool freeAll = true);
         std::string fieldName(v8::Local<v8::Value> value) const throw(Exception&);
         std::string tableName(v8::Local<v8::Value> value, bool escape = true) const throw(Exception&);
         v8::Handle<v8::Value> addCondition(_NAN_METHOD_ARGS, const char* separator);
-        v8::Local<v8::Object> row(Result* result, row_t* currentRow) const;
+        ConversionPlan* plan(execute_request_t* request) const;
+        v8::Local<v8::Object> row(execute_request_t* request, row_t* row) const;
+        ConversionPlan::converter_t converter(Result::Column* column) const;
+        v8::Local<v8::Array> columnar(execute_request_t* request) const;
+        v8::Local<v8::Object> output(execute_request_t* request) const;
+        static void freeOutput(char* data, void* hint);
+        static v8::Local<v8::Object> typedArray(const char* type, const void* data, uint32_t length, size_t size);
+        v8::Local<v8::Array> columns(Result* result) const;
         virtual std::string parseQuery() const throw(Exception&);
         virtual std::vector<std::string::size_type> placeholders(std::string* parsed) const throw(Exception&);
         virtual Result* execute() const throw(Exception&);
+        virtual Result* execute(Connection* connection) const throw(Exception&);
         std::string value(v8::Local<v8::Value> value, bool inArray = false, bool escape = true, int precision = -1) const throw(Exception&);
 
 
     private:
-        static bool gmtDeltaLoaded;
-        static int gmtDelta;
-
         std::string fromDate(const double timeStamp) const throw(Exception&);
 };
 }
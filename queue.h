@@ -0,0 +1,46 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef QUEUE_H_
+#define QUEUE_H_
+
+#include <stddef.h>
+
+namespace node_db {
+// Lock-free multiple producer, single consumer queue of intrusive items
+// (T must have a T* next member). Producers push one item at a time, the
+// consumer takes everything queued so far in one go.
+template <class T> class MpscQueue {
+    public:
+        MpscQueue() : head(NULL) {
+        }
+
+        bool push(T* item) {
+            T* current;
+            do {
+                current = this->head;
+                item->next = current;
+            } while (!__sync_bool_compare_and_swap(&(this->head), current, item));
+            return (current == NULL);
+        }
+
+        T* drain() {
+            T* item = __sync_lock_test_and_set(&(this->head), static_cast<T*>(NULL));
+            T* ordered = NULL;
+            while (item != NULL) {
+                T* next = item->next;
+                item->next = ordered;
+                ordered = item;
+                item = next;
+            }
+            return ordered;
+        }
+
+        bool isEmpty() const {
+            return (this->head == NULL);
+        }
+
+    protected:
+        T* volatile head;
+};
+}
+
+#endif  // QUEUE_H_
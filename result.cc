@@ -1,6 +1,53 @@
 // Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
 #include "./result.h"
 
+node_db::RowBatch::RowBatch(uint16_t columnCount, node_db::Arena* arena, bool copyCells)
+    :cellsPerRow(columnCount),
+    arena(arena),
+    copyCells(copyCells),
+    typed(false),
+    indexes(NULL) {
+}
+
+void node_db::RowBatch::clear() {
+    this->rows.clear();
+    this->typed = false;
+}
+
+void node_db::RowBatch::reserve(size_t rows) {
+    this->rows.reserve(rows);
+}
+
+// Rows added from now on are narrowed to the given columns of theirs, in
+// that order. NULL goes back to taking every column.
+void node_db::RowBatch::select(const std::vector<uint16_t>* indexes) {
+    this->indexes = indexes;
+}
+
+size_t node_db::RowBatch::size() const {
+    return this->rows.size();
+}
+
+uint16_t node_db::RowBatch::columnCount() const {
+    return this->cellsPerRow;
+}
+
+char** node_db::RowBatch::columns(size_t row) {
+    return this->rows[row];
+}
+
+unsigned long* node_db::RowBatch::columnLengths(size_t row) {
+    return reinterpret_cast<unsigned long*>(this->rows[row] + this->cellsPerRow);
+}
+
+const node_db::TypedValue* node_db::RowBatch::values(size_t row) const {
+    if (!this->typed) {
+        return NULL;
+    }
+
+    return reinterpret_cast<const node_db::TypedValue*>(reinterpret_cast<unsigned long*>(this->rows[row] + this->cellsPerRow) + this->cellsPerRow);
+}
+
 node_db::Result::Column::~Column() {
 }
 
@@ -25,3 +72,30 @@ node_db::Result::~Result() {
 
 void node_db::Result::release() throw() {
 }
+
+// Drivers that can hand out several rows per call return true and
+// implement fetchBatch(), which adds up to maxRows rows to the batch and
+// returns how many it added (0 once there are none left). Cells of buffered
+// results must stay valid as long as the result; the batch copies those of
+// unbuffered ones as they are added. Everyone else is read a row at a time
+// with hasNext(), columnLengths() and next().
+bool node_db::Result::isBatched() const throw() {
+    return false;
+}
+
+size_t node_db::Result::fetchBatch(node_db::RowBatch&, size_t) throw(node_db::Exception&) {
+    throw node_db::Exception("Not implemented");
+}
+
+// Drivers that read a binary protocol return true and implement values(),
+// which returns the typed cells of the row last returned by next(), in
+// column order (batched drivers add them to the batch instead). Typed cells
+// that are not NULL still need a non NULL text pointer, but its text is
+// never read, so it can be empty.
+bool node_db::Result::isTyped() const throw() {
+    return false;
+}
+
+const node_db::TypedValue* node_db::Result::values() throw(node_db::Exception&) {
+    throw node_db::Exception("Not implemented");
+}
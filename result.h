@@ -3,11 +3,111 @@
 #define RESULT_H_
 
 #include <stdint.h>
+#include <string.h>
 #include <stdexcept>
 #include <string>
+#include <vector>
+#include "./arena.h"
 #include "./exception.h"
 
 namespace node_db {
+// A cell a driver reads off a binary protocol, delivered as its native value
+// instead of as text. Cells of type TEXT have no typed value.
+struct TypedValue {
+    typedef enum {
+        TEXT,
+        INT64,
+        DOUBLE,
+        TIMESTAMP,
+        BOOLEAN
+    } type_t;
+
+    type_t type;
+    union {
+        int64_t integer;
+        double real;
+        int64_t micros;
+        bool boolean;
+    } value;
+};
+
+// Rows a batched driver hands out, written straight into the arena of the
+// request: each row is one block with its cell pointers, lengths and typed
+// values, which the request keeps as it is. When the cells themselves would
+// not outlive the call (unbuffered results, lazy rows) their bytes are
+// copied too, so drivers may reuse their buffers from one row to the next.
+// A projection can have add() pick some columns of wider rows. add() is
+// defined here so that ResultAdapter's loop compiles it in.
+class RowBatch {
+    public:
+        RowBatch(uint16_t columnCount, Arena* arena, bool copyCells);
+        void clear();
+        void reserve(size_t rows);
+        void select(const std::vector<uint16_t>* indexes);
+        void add(char** columns, const unsigned long* columnLengths) throw(Exception&) {
+            this->add(columns, columnLengths, NULL);
+        }
+        // Rows of one batch either all have typed values or none do
+        void add(char** columns, const unsigned long* columnLengths, const TypedValue* values) throw(Exception&) {
+            size_t size = this->cellsPerRow * (sizeof(char*) + sizeof(unsigned long));
+            if (values != NULL) {
+                size += this->cellsPerRow * sizeof(TypedValue);
+            }
+
+            char** rowColumns = static_cast<char**>(this->arena->allocate(size));
+            unsigned long* rowLengths = reinterpret_cast<unsigned long*>(rowColumns + this->cellsPerRow);
+
+            if (this->indexes != NULL) {
+                for (uint16_t i = 0; i < this->cellsPerRow; i++) {
+                    rowColumns[i] = columns[(*this->indexes)[i]];
+                    rowLengths[i] = columnLengths[(*this->indexes)[i]];
+                }
+            } else {
+                memcpy(rowColumns, columns, this->cellsPerRow * sizeof(char*));
+                memcpy(rowLengths, columnLengths, this->cellsPerRow * sizeof(unsigned long));
+            }
+
+            if (values != NULL) {
+                TypedValue* rowValues = reinterpret_cast<TypedValue*>(rowLengths + this->cellsPerRow);
+                for (uint16_t i = 0; i < this->cellsPerRow; i++) {
+                    rowValues[i] = values[this->indexes != NULL ? (*this->indexes)[i] : i];
+                }
+                this->typed = true;
+            }
+
+            if (this->copyCells) {
+                size_t bytes = 0;
+                for (uint16_t i = 0; i < this->cellsPerRow; i++) {
+                    bytes += rowLengths[i];
+                }
+
+                char* cell = this->arena->allocate<char>(bytes);
+                for (uint16_t i = 0; i < this->cellsPerRow; i++) {
+                    if (rowColumns[i] != NULL) {
+                        memcpy(cell, rowColumns[i], rowLengths[i]);
+                        rowColumns[i] = cell;
+                        cell += rowLengths[i];
+                    }
+                }
+            }
+
+            this->rows.push_back(rowColumns);
+        }
+        size_t size() const;
+        uint16_t columnCount() const;
+        char** columns(size_t row);
+        unsigned long* columnLengths(size_t row);
+        const TypedValue* values(size_t row) const;
+
+    protected:
+        uint16_t cellsPerRow;
+        Arena* arena;
+        bool copyCells;
+        bool typed;
+        const std::vector<uint16_t>* indexes;
+        std::vector<char**> rows;
+};
+
 class Result {
     public:
         class Column {
@@ -45,6 +145,10 @@ class Result {
         virtual uint64_t count() const throw(Exception&);
         virtual bool isBuffered() const throw() = 0;
         virtual bool isEmpty() const throw() = 0;
+        virtual bool isBatched() const throw();
+        virtual size_t fetchBatch(RowBatch& batch, size_t maxRows) throw(Exception&);
+        virtual bool isTyped() const throw();
+        virtual const TypedValue* values() throw(Exception&);
 };
 }
 
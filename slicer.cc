@@ -0,0 +1,88 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#include "./slicer.h"
+
+// Rows in the first slice when only a time budget is given
+#define SLICER_PROBE_ROWS 256
+
+uv_check_t node_db::TimeSlicer::g_check;
+uv_idle_t node_db::TimeSlicer::g_idle;
+bool node_db::TimeSlicer::handlesLoaded = false;
+std::deque<node_db::TimeSlicer::task_t*> node_db::TimeSlicer::tasks;
+
+// maxRows caps every slice and budget is in microseconds; either can be 0,
+// but not both. The first slice runs right away.
+void node_db::TimeSlicer::run(slice_cb slice, void* data, uint32_t maxRows, uint32_t budget) {
+    task_t* task = new task_t();
+    task->slice = slice;
+    task->data = data;
+    task->maxRows = maxRows;
+    task->budget = static_cast<uint64_t>(budget) * 1000;
+    task->rows = (maxRows > 0 && (budget == 0 || maxRows < SLICER_PROBE_ROWS) ? maxRows : SLICER_PROBE_ROWS);
+    task->cost = 0;
+
+    if (TimeSlicer::step(task)) {
+        delete task;
+        return;
+    }
+
+    if (!TimeSlicer::handlesLoaded) {
+        uv_check_init(uv_default_loop(), &g_check);
+        uv_idle_init(uv_default_loop(), &g_idle);
+        TimeSlicer::handlesLoaded = true;
+    }
+
+    if (TimeSlicer::tasks.empty()) {
+        uv_check_start(&g_check, uvCheck);
+        uv_idle_start(&g_idle, uvIdle);
+    }
+    TimeSlicer::tasks.push_back(task);
+}
+
+bool node_db::TimeSlicer::step(task_t* task) {
+    uint64_t start = uv_hrtime();
+    if (!task->slice(task->data, task->rows)) {
+        return true;
+    }
+
+    if (task->budget > 0) {
+        // Smoothed so a single slow slice (a GC pause) doesn't shrink the
+        // next ones too much
+        double cost = static_cast<double>(uv_hrtime() - start) / task->rows;
+        task->cost = (task->cost > 0 ? (task->cost * 3 + cost) / 4 : cost);
+
+        double rows = (task->cost > 0 ? task->budget / task->cost : task->budget);
+        if (task->maxRows > 0 && rows > task->maxRows) {
+            rows = task->maxRows;
+        } else if (rows > 0xFFFFFFFF) {
+            rows = 0xFFFFFFFF;
+        }
+        task->rows = (rows >= 1 ? static_cast<uint32_t>(rows) : 1);
+    }
+
+    return false;
+}
+
+// Every pending task gets one slice per loop iteration. Slices may start new
+// tasks, which wait for the next iteration.
+void node_db::TimeSlicer::uvCheck(uv_check_t* handle, int status) {
+    for (size_t pending = TimeSlicer::tasks.size(); pending > 0; pending--) {
+        task_t* task = TimeSlicer::tasks.front();
+        TimeSlicer::tasks.pop_front();
+
+        if (TimeSlicer::step(task)) {
+            delete task;
+        } else {
+            TimeSlicer::tasks.push_back(task);
+        }
+    }
+
+    if (TimeSlicer::tasks.empty()) {
+        uv_check_stop(&g_check);
+        uv_idle_stop(&g_idle);
+    }
+}
+
+void node_db::TimeSlicer::uvIdle(uv_idle_t* handle, int status) {
+}
+
+#undef SLICER_PROBE_ROWS
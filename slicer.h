@@ -0,0 +1,43 @@
+// Copyright 2011 Mariano Iglesias <mgiglesias@gmail.com>
+#ifndef SLICER_H_
+#define SLICER_H_
+
+#include <stdint.h>
+#include <uv.h>
+#include <deque>
+
+namespace node_db {
+// Runs long main thread jobs (converting a large result, say) a slice of
+// rows at a time, yielding to the event loop between slices the way
+// setImmediate does: pending slices run from a check handle, and an idle
+// handle keeps the loop from blocking in poll while any are left. With a
+// time budget, the slice size follows the measured cost per row so every
+// slice stays around the budget.
+class TimeSlicer {
+    public:
+        // Processes up to rows rows, returning whether any are left
+        typedef bool (*slice_cb)(void* data, uint32_t rows);
+
+        static void run(slice_cb slice, void* data, uint32_t maxRows, uint32_t budget);
+
+    protected:
+        struct task_t {
+            slice_cb slice;
+            void* data;
+            uint32_t maxRows;
+            uint64_t budget;
+            uint32_t rows;
+            double cost;
+        };
+        static uv_check_t g_check;
+        static uv_idle_t g_idle;
+        static bool handlesLoaded;
+        static std::deque<task_t*> tasks;
+
+        static bool step(task_t* task);
+        static void uvCheck(uv_check_t* handle, int status);
+        static void uvIdle(uv_idle_t* handle, int status);
+};
+}
+
+#endif  // SLICER_H_
@@ -15,6 +15,64 @@ exports.get = function(createDbClient, quoteName) {
         quoteName = '`';
     }
 
+    // Run by both engines, see below
+    var streamTest = function(test) {
+        var client = this.client, query = client.query(), chunks = 0, total = 0;
+        test.expect(3);
+
+        query.on('rows', function (rows) {
+            chunks++;
+            total += rows.length;
+        });
+
+        query.execute('SELECT 1 AS value UNION ALL SELECT 2 UNION ALL SELECT 3', { stream: true, highWaterMark: 2 }, function (error) {
+            test.equal(null, error);
+            test.equal(3, total);
+            test.equal(2, chunks);
+            test.done();
+        });
+    };
+
+    var resumeTest = function(test) {
+        var client = this.client, query = client.query(), chunks = 0, total = 0, calls = 0;
+        test.expect(4);
+
+        query.on('rows', function (rows) {
+            chunks++;
+            total += rows.length;
+            query.pause();
+            query.resume();
+        });
+
+        query.execute('SELECT 1 AS value UNION ALL SELECT 2 UNION ALL SELECT 3', { stream: true, highWaterMark: 1 }, function (error) {
+            calls++;
+            test.equal(null, error);
+            test.equal(3, total);
+            test.equal(3, chunks);
+            setTimeout(function () {
+                test.equal(1, calls);
+                test.done();
+            }, 50);
+        });
+    };
+
+    var concurrentTest = function(test) {
+        var client = this.client, pending = 10;
+        test.expect(20);
+
+        for (var i = 0; i < 10; i++) {
+            (function (i) {
+                client.query('SELECT ' + i + ' AS value').execute(function (error, rows) {
+                    test.equal(null, error);
+                    test.equal(i, rows[0].value);
+                    if (--pending === 0) {
+                        test.done();
+                    }
+                });
+            })(i);
+        }
+    };
+
     exports["Client"] = testCase({
         "setUp": function(callback) {
             var self = this;
@@ -48,6 +106,312 @@ exports.get = function(createDbClient, quoteName) {
             
             test.done();
         },
+        "connection pool": function(test) {
+            var client = this.client;
+            test.expect(1);
+
+            try {
+                client.connect({ poolMax: 3 }, function (error) {
+                    test.equal(null, error);
+                    test.done();
+                });
+            } catch (error) {
+                // Drivers that can't create connections can't pool
+                test.equal('Driver does not support pooling', error.message);
+                test.done();
+            }
+        },
+        "stream": streamTest,
+        "resume() from a rows listener": resumeTest,
+        "eachBatch": function(test) {
+            var client = this.client, query = client.query(), batches = [];
+            test.expect(3);
+
+            query.on('eachBatch', function (rows, index, last) {
+                batches.push([rows.length, index, last]);
+            });
+
+            query.execute('SELECT 1 AS value UNION ALL SELECT 2 UNION ALL SELECT 3', { eachBatchSize: 2 }, function (error, rows) {
+                test.equal(null, error);
+                test.equal(3, rows.length);
+                test.deepEqual([[2, 0, false], [1, 2, true]], batches);
+                test.done();
+            });
+        },
+        "sliced conversion": function(test) {
+            var client = this.client;
+            test.expect(2);
+
+            client.query('SELECT 1 AS value UNION ALL SELECT 2 UNION ALL SELECT 3', { sliceRows: 1, sliceTime: 1000 }).execute(function (error, rows) {
+                test.equal(null, error);
+                test.deepEqual([{ value: 1 }, { value: 2 }, { value: 3 }], rows);
+                test.done();
+            });
+        },
+        "cursor()": function(test) {
+            var client = this.client, cursor = client.query().cursor('SELECT 1 AS value UNION ALL SELECT 2 UNION ALL SELECT 3');
+            test.expect(6);
+
+            cursor.fetch(2, function (error, rows) {
+                test.equal(null, error);
+                test.equal(2, rows.length);
+                cursor.fetch(2, function (error, rows) {
+                    test.equal(null, error);
+                    test.equal(1, rows.length);
+                    var returned = false;
+                    cursor.fetch(2, function (error, rows) {
+                        test.ok(returned);
+                        test.equal(0, rows.length);
+                        cursor.close();
+                        test.done();
+                    });
+                    returned = true;
+                });
+            });
+        },
+        "columnar layout": function(test) {
+            var client = this.client;
+            test.expect(6);
+
+            client.query('SELECT 1 AS value, \'a\' AS name UNION ALL SELECT 2, NULL', { layout: 'columnar' }).execute(function (error, columns) {
+                test.equal(null, error);
+                test.equal(2, columns.length);
+                test.equal(2, columns[0].values.length);
+                test.equal(3, columns[0].values[0] + columns[0].values[1]);
+                test.equal(null, columns[1].values[1]);
+                test.equal(1, columns[1].validity[0]);
+                test.done();
+            });
+        },
+        "array row mode": function(test) {
+            var client = this.client;
+            test.expect(4);
+
+            client.query('SELECT 1 AS first, 2 AS second', { rowMode: 'array' }).execute(function (error, rows, columns) {
+                test.equal(null, error);
+                test.ok(Array.isArray(rows[0]));
+                test.deepEqual([1, 2], rows[0]);
+                test.equal('second', columns[1].name);
+                test.done();
+            });
+        },
+        "lazy rows": function(test) {
+            var client = this.client;
+            test.expect(5);
+
+            client.query('SELECT 1 AS first, \'a\' AS second', { lazy: true }).execute(function (error, rows) {
+                test.equal(null, error);
+                test.strictEqual(1, rows[0].first);
+                test.deepEqual(['first', 'second'], Object.keys(rows[0]));
+                test.equal('{"first":1,"second":"a"}', JSON.stringify(rows[0]));
+                test.ok('second' in rows[0]);
+                test.done();
+            });
+        },
+        "column projection": function(test) {
+            var client = this.client;
+            test.expect(3);
+
+            client.query('SELECT 1 AS first, 2 AS second, 3 AS third', { columns: ['third', 'first'] }).execute(function (error, rows, columns) {
+                test.equal(null, error);
+                test.deepEqual({ third: 3, first: 1 }, rows[0]);
+                test.equal('first', columns[1].name);
+                test.done();
+            });
+        },
+        "binary cells": function(test) {
+            var client = this.client;
+            test.expect(4);
+
+            client.query('SELECT X\'00FF80C328\' AS bytes, \'caf\u00e9\' AS name', { bufferText: true }).execute(function (error, rows) {
+                test.equal(null, error);
+                test.ok(Buffer.isBuffer(rows[0].bytes));
+                test.equal('00ff80c328', rows[0].bytes.toString('hex'));
+                test.equal('636166c3a9', rows[0].name.toString('hex'));
+                test.done();
+            });
+        },
+        "binary cells outlive their query": function(test) {
+            var client = this.client, query = client.query(), kept = [];
+            test.expect(4);
+
+            query.on('rows', function (rows) {
+                rows.forEach(function (row) {
+                    kept.push(row.bytes);
+                });
+            });
+
+            query.execute('SELECT X\'00FF\' AS bytes UNION ALL SELECT X\'80C3\' UNION ALL SELECT X\'28\'', { stream: true, highWaterMark: 1 }, function (error) {
+                test.equal(null, error);
+
+                // Row memory of the finished query is reused or freed by now
+                client.query('SELECT REPEAT(\'x\', 100000) AS filler UNION ALL SELECT REPEAT(\'y\', 100000)').execute(function (error) {
+                    test.equal(null, error);
+                    test.ok(kept.every(Buffer.isBuffer));
+                    test.deepEqual(['00ff', '80c3', '28'], kept.map(function (bytes) { return bytes.toString('hex'); }));
+                    test.done();
+                });
+            });
+        },
+        "external strings": function(test) {
+            var client = this.client, ascii = new Array(65).join('abcdefgh'), other = new Array(65).join('caf\u00e9 ');
+            test.expect(5);
+
+            // Only rows read off an unbuffered result can be external, so
+            // both queries stream theirs
+            function read(options, callback) {
+                var query = client.query(), rows = [];
+                query.on('rows', function (chunk) {
+                    rows = rows.concat(chunk);
+                });
+                query.execute('SELECT REPEAT(\'abcdefgh\', 64) AS ascii, REPEAT(\'caf\u00e9 \', 64) AS other, \'short\' AS small', options, function (error) {
+                    test.equal(null, error);
+                    callback(rows);
+                });
+            }
+
+            read({ stream: true, externalStrings: 16 }, function (external) {
+                read({ stream: true }, function (rows) {
+                    test.deepEqual([{ ascii: ascii, other: other, small: 'short' }], external);
+                    test.deepEqual(rows, external);
+                    test.equal(ascii.length, external[0].ascii.length);
+                    test.done();
+                });
+            });
+        },
+        "set columns": function(test) {
+            var client = this.client, members = [];
+            test.expect(8);
+
+            for (var i = 0; i < 64; i++) {
+                members.push('m' + i);
+            }
+
+            // 64 members is as many as a SET can have, which fills every
+            // slot of the interned member strings before the last row
+            client.query('DROP TABLE IF EXISTS set_members').execute(function () {
+                client.query('CREATE TABLE set_members (id INT, tags SET(\'' + members.join('\', \'') + '\'))').execute(function (error) {
+                    test.equal(null, error);
+                    client.query(
+                        'INSERT INTO set_members VALUES (1, \'\'), (2, \'m7\'), (3, \'m1,m5,m9\'), ' +
+                        '(4, \'' + members.join(',') + '\'), (5, \'m63,m0\')'
+                    ).execute(function (error) {
+                        test.equal(null, error);
+                        client.query('SELECT tags FROM set_members ORDER BY id').execute(function (error, rows) {
+                            test.equal(null, error);
+                            test.deepEqual([], rows[0].tags);
+                            test.deepEqual(['m7'], rows[1].tags);
+                            test.deepEqual(['m1', 'm5', 'm9'], rows[2].tags);
+                            test.deepEqual(members, rows[3].tags);
+                            test.deepEqual(['m0', 'm63'], rows[4].tags);
+                            client.query('DROP TABLE IF EXISTS set_members').execute();
+                            test.done();
+                        });
+                    });
+                });
+            });
+        },
+        "dictionary strings": function(test) {
+            var client = this.client;
+            test.expect(3);
+
+            client.query('SELECT \'open\' AS status UNION ALL SELECT \'closed\' UNION ALL SELECT \'open\'', { dictionary: true }).execute(function (error, rows) {
+                test.equal(null, error);
+                test.deepEqual(['open', 'closed', 'open'], rows.map(function (row) { return row.status; }));
+                test.equal(3, rows.length);
+                test.done();
+            });
+        },
+        "json format": function(test) {
+            var client = this.client;
+            test.expect(3);
+
+            client.query('SELECT 1 AS value, \'a"b\' AS name UNION ALL SELECT 2, NULL', { format: 'json' }).execute(function (error, json) {
+                test.equal(null, error);
+                test.ok(Buffer.isBuffer(json));
+                test.deepEqual([{ value: 1, name: 'a"b' }, { value: 2, name: null }], JSON.parse(json.toString()));
+                test.done();
+            });
+        },
+        "json number text": function(test) {
+            var client = this.client;
+            test.expect(3);
+
+            client.query('SELECT 0.1 AS low, 0.3333333333333333 AS third, 1.50 AS price', { format: 'json' }).execute(function (error, json) {
+                test.equal(null, error);
+                test.equal('[{"low":0.1,"third":0.3333333333333333,"price":1.50}]', json.toString());
+                test.deepEqual([{ low: 0.1, third: 0.3333333333333333, price: 1.5 }], JSON.parse(json.toString()));
+                test.done();
+            });
+        },
+        "arrow format": function(test) {
+            var client = this.client;
+            test.expect(5);
+
+            client.query('SELECT 1 AS value UNION ALL SELECT 2', { format: 'arrow-file' }).execute(function (error, arrow) {
+                test.equal(null, error);
+                test.ok(Buffer.isBuffer(arrow));
+                test.equal('ARROW1', arrow.toString('binary', 0, 6));
+                test.equal('ARROW1', arrow.toString('binary', arrow.length - 6));
+                test.equal(0xFFFFFFFF, arrow.readUInt32LE(8));
+                test.done();
+            });
+        },
+        "exact bigint": function(test) {
+            var client = this.client;
+            test.expect(3);
+
+            client.query('SELECT CAST(42 AS SIGNED) AS small, CAST(9007199254740993 AS SIGNED) AS big', { bigint: 'exact' }).execute(function (error, rows) {
+                test.equal(null, error);
+                test.strictEqual(42, rows[0].small);
+                test.strictEqual('9007199254740993', rows[0].big);
+                test.done();
+            });
+        },
+        "utc dates": function(test) {
+            var client = this.client;
+            test.expect(3);
+
+            client.query('SELECT CAST(\'2024-07-15 10:30:00.250\' AS DATETIME(3)) AS moment, CAST(\'2024-07-15\' AS DATE) AS day', { timezone: 'utc' }).execute(function (error, rows) {
+                test.equal(null, error);
+                test.equal(Date.UTC(2024, 6, 15, 10, 30, 0, 250), rows[0].moment.getTime());
+                test.equal(Date.UTC(2024, 6, 15), rows[0].day.getTime());
+                test.done();
+            });
+        },
+        "default dates are utc": function(test) {
+            var client = this.client;
+            test.expect(2);
+
+            client.query('SELECT CAST(\'2024-01-15 10:00:00\' AS DATETIME) AS moment').execute(function (error, rows) {
+                test.equal(null, error);
+                test.equal(Date.UTC(2024, 0, 15, 10), rows[0].moment.getTime());
+                test.done();
+            });
+        },
+        "local dates": function(test) {
+            var client = this.client;
+            test.expect(2);
+
+            client.query('SELECT CAST(\'2024-01-15 10:00:00\' AS DATETIME) AS moment', { timezone: 'local' }).execute(function (error, rows) {
+                test.equal(null, error);
+                test.equal(new Date(2024, 0, 15, 10).getTime(), rows[0].moment.getTime());
+                test.done();
+            });
+        },
+        "stats()": function(test) {
+            var client = this.client;
+            test.expect(4);
+
+            client.query('SELECT 1').execute(function (error) {
+                var stats = client.stats();
+                test.equal(null, error);
+                test.ok(stats.connections >= 1);
+                test.ok(stats.completions >= stats.wakeups);
+                test.ok(stats.wakeups === 0 || stats.averageBatch >= 1);
+                test.done();
+            });
+        },
         "multiple results": function(test) {
             var client = this.client;
             test.expect(1);
@@ -67,7 +431,25 @@ exports.get = function(createDbClient, quoteName) {
                     });
                 });
             });
-        }
+        },
+        "concurrent queries": concurrentTest
+    });
+
+    // The same tests with every connection's work on a dedicated thread
+    // instead of the libuv threadpool
+    exports["Client (thread engine)"] = testCase({
+        "setUp": function(callback) {
+            var self = this;
+            createDbClient(function(client) {
+                client.connect({ engine: 'thread' }, function(error) {
+                    self.client = client;
+                    callback();
+                });
+            });
+        },
+        "stream": streamTest,
+        "resume() from a rows listener": resumeTest,
+        "concurrent queries": concurrentTest
     });
 
     exports["Query"] = testCase({